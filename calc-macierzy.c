@@ -3,15 +3,30 @@
 //      Bartłomiej Mystykowski
 /////
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <errno.h>
 #include <ctype.h>
-
-#define LINE_BUF_SIZE 16384
+#include <time.h>
+#include <malloc.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 
 typedef struct { float re, im; } Complex;
+typedef struct { double re, im; } ComplexD;     // --precision f64
 
 // --- Deklaracje funkcji rzeczywistych ---
 int wczytaj_macierz(const char *nazwa_pliku, float **pmat, int *prows, int *pcols);
@@ -19,7 +34,9 @@ void wypisz_macierz(const float *mat, int rows, int cols);
 int dodaj_macierze(const float *a, const float *b, float *wynik, int rows, int cols);
 int odejmij_macierze(const float *a, const float *b, float *wynik, int rows, int cols);
 int mnoz_macierze(const float *a, int a_rows, int a_cols, const float *b, int b_rows, int b_cols, float *wynik);
+int mnoz_macierze_ref(const float *a, int a_rows, int a_cols, const float *b, int b_rows, int b_cols, float *wynik);
 void transpose_float(const float *src, float *dst, int rows, int cols);
+int transpose_float_inplace(float *mat, int rows, int cols);
 int save_matrix_float(const char *filename, const float *mat, int rows, int cols);
 
 // --- Deklaracje funkcji zespolonych ---
@@ -27,296 +44,4796 @@ int wczytaj_macierz_complex(const char *nazwa_pliku, Complex **pmat, int *prows,
 void wypisz_macierz_complex(const Complex *mat, int rows, int cols);
 void dodaj_macierze_complex(const Complex *a, const Complex *b, Complex *wynik, int rows, int cols);
 void odejmij_macierze_complex(const Complex *a, const Complex *b, Complex *wynik, int rows, int cols);
-void mnoz_macierze_complex(const Complex *a, int a_rows, int a_cols, const Complex *b, int b_rows, int b_cols, Complex *wynik);
+int mnoz_macierze_complex(const Complex *a, int a_rows, int a_cols, const Complex *b, int b_rows, int b_cols, Complex *wynik);
 void transpose_complex(const Complex *src, Complex *dst, int rows, int cols);
+int transpose_complex_inplace(Complex *mat, int rows, int cols);
 int save_matrix_complex(const char *filename, const Complex *mat, int rows, int cols);
 
-// --- Pomocnicze ---
-static int is_blank_line(const char *s) {
-    while (*s) {
-        if (*s != '\n' && *s != '\r' && *s != ' ' && *s != '\t') return 0;
-        s++;
+// --- Deklaracje wspolne ---
+void zwolnij_macierz(void *p);
+
+// --- Jadra obliczeniowe (skalarne i SIMD) z wyborem w czasie uruchomienia ---
+// Wymiary kafelka rejestrowego mikrojadra GEMM; wspolne dla wszystkich wariantow,
+// zeby spakowane panele mialy ten sam uklad niezaleznie od wybranego zestawu instrukcji.
+#define GEMM_MR 6
+#define GEMM_NR 16
+// Kafelek mikrojadra double (--precision mixed/f64): ten sam rozmiar w bajtach wiersza co we float.
+#define GEMM_MR_D 6
+#define GEMM_NR_D 8
+
+typedef void (*jadro_ew_t)(const float *a, const float *b, float *w, size_t n);
+typedef void (*jadro_mikro_t)(int kc, const float *ap, const float *bp, float *c, long ldc,
+                              float alpha, int akumuluj, int mr, int nr);
+typedef void (*jadro_mikro_d_t)(int kc, const double *ap, const double *bp, double *c, long ldc,
+                                double alpha, int akumuluj, int mr, int nr);
+typedef void (*jadro_caxpy_t)(size_t n, Complex alfa, const Complex *x, Complex *y);
+// Transpozycja kafelka rejestrowego b x b (b = jadra.tr_f dla float, jadra.tr_c dla Complex); kroki w elementach.
+typedef void (*jadro_transp_t)(const void *src, long lds, void *dst, long ldd);
+
+static void dodaj_skalar(const float *a, const float *b, float *w, size_t n) {
+    for (size_t i = 0; i < n; ++i) w[i] = a[i] + b[i];
+}
+static void odejmij_skalar(const float *a, const float *b, float *w, size_t n) {
+    for (size_t i = 0; i < n; ++i) w[i] = a[i] - b[i];
+}
+// Zapis kafelka akumulatorow do C z mnoznikiem alpha; wspolny dla brzegow wszystkich wariantow.
+static void zapisz_kafelek(const float *acc, float *c, long ldc, float alpha, int akumuluj, int mr, int nr) {
+    for (int r = 0; r < mr; ++r) {
+        float *crow = c + (long)r * ldc;
+        const float *arow = acc + r * GEMM_NR;
+        if (akumuluj) for (int j = 0; j < nr; ++j) crow[j] += alpha * arow[j];
+        else for (int j = 0; j < nr; ++j) crow[j] = alpha * arow[j];
+    }
+}
+// Mikrojadro: C[mr x nr] (+)= alpha * Ap * Bp, akumulacja w rejestrach.
+static void mikrojadro_skalar(int kc, const float *ap, const float *bp, float *c, long ldc,
+                              float alpha, int akumuluj, int mr, int nr) {
+    float acc[GEMM_MR][GEMM_NR];
+    memset(acc, 0, sizeof(acc));
+    for (int k = 0; k < kc; ++k) {
+        for (int r = 0; r < GEMM_MR; ++r) {
+            float av = ap[r];
+            for (int j = 0; j < GEMM_NR; ++j) acc[r][j] += av * bp[j];
+        }
+        ap += GEMM_MR; bp += GEMM_NR;
+    }
+    zapisz_kafelek(&acc[0][0], c, ldc, alpha, akumuluj, mr, nr);
+}
+static void zapisz_kafelek_d(const double *acc, double *c, long ldc, double alpha, int akumuluj, int mr, int nr) {
+    for (int r = 0; r < mr; ++r) {
+        double *crow = c + (long)r * ldc;
+        const double *arow = acc + r * GEMM_NR_D;
+        if (akumuluj) for (int j = 0; j < nr; ++j) crow[j] += alpha * arow[j];
+        else for (int j = 0; j < nr; ++j) crow[j] = alpha * arow[j];
+    }
+}
+static void mikrojadro_d_skalar(int kc, const double *ap, const double *bp, double *c, long ldc,
+                                double alpha, int akumuluj, int mr, int nr) {
+    double acc[GEMM_MR_D][GEMM_NR_D];
+    memset(acc, 0, sizeof(acc));
+    for (int k = 0; k < kc; ++k) {
+        for (int r = 0; r < GEMM_MR_D; ++r) {
+            double av = ap[r];
+            for (int j = 0; j < GEMM_NR_D; ++j) acc[r][j] += av * bp[j];
+        }
+        ap += GEMM_MR_D; bp += GEMM_NR_D;
+    }
+    zapisz_kafelek_d(&acc[0][0], c, ldc, alpha, akumuluj, mr, nr);
+}
+// y += alfa * x dla wektorow zespolonych.
+static void caxpy_skalar(size_t n, Complex alfa, const Complex *x, Complex *y) {
+    for (size_t j = 0; j < n; ++j) {
+        float xr = x[j].re, xi = x[j].im;
+        y[j].re += alfa.re * xr - alfa.im * xi;
+        y[j].im += alfa.re * xi + alfa.im * xr;
+    }
+}
+static void transp_f32_skalar(const void *src, long lds, void *dst, long ldd) {
+    const float *a = src; float *b = dst;
+    for (int i = 0; i < 8; ++i)
+        for (int j = 0; j < 8; ++j) b[(long)j * ldd + i] = a[(long)i * lds + j];
+}
+static void transp_c32_skalar(const void *src, long lds, void *dst, long ldd) {
+    const Complex *a = src; Complex *b = dst;
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j) b[(long)j * ldd + i] = a[(long)i * lds + j];
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JADRA_X86 1
+#include <immintrin.h>
+
+// SSE2: 4 floaty na rejestr. Zespolone bez addsub (SSE3) - znak czesci rzeczywistej
+// odwracamy maska XOR.
+__attribute__((target("sse2")))
+static void dodaj_sse2(const float *a, const float *b, float *w, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(w + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    for (; i < n; ++i) w[i] = a[i] + b[i];
+}
+__attribute__((target("sse2")))
+static void odejmij_sse2(const float *a, const float *b, float *w, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(w + i, _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    for (; i < n; ++i) w[i] = a[i] - b[i];
+}
+__attribute__((target("sse2")))
+static void mikrojadro_sse2(int kc, const float *ap, const float *bp, float *c, long ldc,
+                            float alpha, int akumuluj, int mr, int nr) {
+    __m128 acc[GEMM_MR][4];
+    for (int r = 0; r < GEMM_MR; ++r) for (int v = 0; v < 4; ++v) acc[r][v] = _mm_setzero_ps();
+    for (int k = 0; k < kc; ++k) {
+        __m128 b0 = _mm_load_ps(bp), b1 = _mm_load_ps(bp + 4), b2 = _mm_load_ps(bp + 8), b3 = _mm_load_ps(bp + 12);
+        for (int r = 0; r < GEMM_MR; ++r) {
+            __m128 av = _mm_set1_ps(ap[r]);
+            acc[r][0] = _mm_add_ps(acc[r][0], _mm_mul_ps(av, b0));
+            acc[r][1] = _mm_add_ps(acc[r][1], _mm_mul_ps(av, b1));
+            acc[r][2] = _mm_add_ps(acc[r][2], _mm_mul_ps(av, b2));
+            acc[r][3] = _mm_add_ps(acc[r][3], _mm_mul_ps(av, b3));
+        }
+        ap += GEMM_MR; bp += GEMM_NR;
+    }
+    float tmp[GEMM_MR * GEMM_NR];
+    for (int r = 0; r < GEMM_MR; ++r) for (int v = 0; v < 4; ++v) _mm_storeu_ps(tmp + r * GEMM_NR + v * 4, acc[r][v]);
+    zapisz_kafelek(tmp, c, ldc, alpha, akumuluj, mr, nr);
+}
+// Wiersz kafelka double to 4 rejestry; 24 akumulatory nie mieszcza sie w 16 xmm, wiec kafelek
+// liczony jest dwiema polowkami po 4 kolumny.
+__attribute__((target("sse2")))
+static void mikrojadro_d_sse2(int kc, const double *ap, const double *bp, double *c, long ldc,
+                             double alpha, int akumuluj, int mr, int nr) {
+    double tmp[GEMM_MR_D * GEMM_NR_D];
+    for (int h = 0; h < GEMM_NR_D; h += 4) {
+        __m128d acc[GEMM_MR_D][2];
+        for (int r = 0; r < GEMM_MR_D; ++r) acc[r][0] = acc[r][1] = _mm_setzero_pd();
+        const double *a = ap, *b = bp + h;
+        for (int k = 0; k < kc; ++k) {
+            __m128d b0 = _mm_load_pd(b), b1 = _mm_load_pd(b + 2);
+            for (int r = 0; r < GEMM_MR_D; ++r) {
+                __m128d av = _mm_set1_pd(a[r]);
+                acc[r][0] = _mm_add_pd(acc[r][0], _mm_mul_pd(av, b0));
+                acc[r][1] = _mm_add_pd(acc[r][1], _mm_mul_pd(av, b1));
+            }
+            a += GEMM_MR_D; b += GEMM_NR_D;
+        }
+        for (int r = 0; r < GEMM_MR_D; ++r) { _mm_storeu_pd(tmp + r * GEMM_NR_D + h, acc[r][0]); _mm_storeu_pd(tmp + r * GEMM_NR_D + h + 2, acc[r][1]); }
+    }
+    zapisz_kafelek_d(tmp, c, ldc, alpha, akumuluj, mr, nr);
+}
+__attribute__((target("sse2")))
+static void caxpy_sse2(size_t n, Complex alfa, const Complex *x, Complex *y) {
+    const __m128 ar = _mm_set1_ps(alfa.re), ai = _mm_set1_ps(alfa.im);
+    const __m128 znak = _mm_castsi128_ps(_mm_set_epi32(0, (int)0x80000000, 0, (int)0x80000000));
+    float *yf = (float *)y; const float *xf = (const float *)x;
+    size_t j = 0;
+    for (; j + 2 <= n; j += 2) {
+        __m128 xv = _mm_loadu_ps(xf + 2 * j);
+        __m128 xs = _mm_shuffle_ps(xv, xv, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128 p = _mm_add_ps(_mm_mul_ps(ar, xv), _mm_xor_ps(_mm_mul_ps(ai, xs), znak));
+        _mm_storeu_ps(yf + 2 * j, _mm_add_ps(_mm_loadu_ps(yf + 2 * j), p));
+    }
+    caxpy_skalar(n - j, alfa, x + j, y + j);
+}
+// Complex to 8 bajtow, wiec transpozycja zespolona to transpozycja doubli.
+__attribute__((target("sse2")))
+static void transp_f32_sse2(const void *src, long lds, void *dst, long ldd) {
+    const float *a = src; float *b = dst;
+    __m128 r0 = _mm_loadu_ps(a), r1 = _mm_loadu_ps(a + lds), r2 = _mm_loadu_ps(a + 2 * lds), r3 = _mm_loadu_ps(a + 3 * lds);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(b, r0); _mm_storeu_ps(b + ldd, r1); _mm_storeu_ps(b + 2 * ldd, r2); _mm_storeu_ps(b + 3 * ldd, r3);
+}
+__attribute__((target("sse2")))
+static void transp_c32_sse2(const void *src, long lds, void *dst, long ldd) {
+    const double *a = src; double *b = dst;
+    __m128d r0 = _mm_loadu_pd(a), r1 = _mm_loadu_pd(a + lds);
+    _mm_storeu_pd(b, _mm_unpacklo_pd(r0, r1));
+    _mm_storeu_pd(b + ldd, _mm_unpackhi_pd(r0, r1));
+}
+
+// AVX2 + FMA: 8 floatow na rejestr, kafelek 6x16 = 12 akumulatorow ymm.
+__attribute__((target("avx2,fma")))
+static void dodaj_avx2(const float *a, const float *b, float *w, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(w + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    for (; i < n; ++i) w[i] = a[i] + b[i];
+}
+__attribute__((target("avx2,fma")))
+static void odejmij_avx2(const float *a, const float *b, float *w, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(w + i, _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    for (; i < n; ++i) w[i] = a[i] - b[i];
+}
+__attribute__((target("avx2,fma")))
+static void mikrojadro_avx2(int kc, const float *ap, const float *bp, float *c, long ldc,
+                            float alpha, int akumuluj, int mr, int nr) {
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps(), c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps(), c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps(), c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+    for (int k = 0; k < kc; ++k) {
+        __m256 b0 = _mm256_load_ps(bp), b1 = _mm256_load_ps(bp + 8);
+        __m256 av;
+        av = _mm256_broadcast_ss(ap + 0); c00 = _mm256_fmadd_ps(av, b0, c00); c01 = _mm256_fmadd_ps(av, b1, c01);
+        av = _mm256_broadcast_ss(ap + 1); c10 = _mm256_fmadd_ps(av, b0, c10); c11 = _mm256_fmadd_ps(av, b1, c11);
+        av = _mm256_broadcast_ss(ap + 2); c20 = _mm256_fmadd_ps(av, b0, c20); c21 = _mm256_fmadd_ps(av, b1, c21);
+        av = _mm256_broadcast_ss(ap + 3); c30 = _mm256_fmadd_ps(av, b0, c30); c31 = _mm256_fmadd_ps(av, b1, c31);
+        av = _mm256_broadcast_ss(ap + 4); c40 = _mm256_fmadd_ps(av, b0, c40); c41 = _mm256_fmadd_ps(av, b1, c41);
+        av = _mm256_broadcast_ss(ap + 5); c50 = _mm256_fmadd_ps(av, b0, c50); c51 = _mm256_fmadd_ps(av, b1, c51);
+        ap += GEMM_MR; bp += GEMM_NR;
+    }
+    __m256 acc[GEMM_MR][2] = { { c00, c01 }, { c10, c11 }, { c20, c21 }, { c30, c31 }, { c40, c41 }, { c50, c51 } };
+    if (mr == GEMM_MR && nr == GEMM_NR) {
+        __m256 al = _mm256_set1_ps(alpha);
+        for (int r = 0; r < GEMM_MR; ++r) {
+            float *crow = c + (long)r * ldc;
+            if (akumuluj) {
+                _mm256_storeu_ps(crow, _mm256_fmadd_ps(al, acc[r][0], _mm256_loadu_ps(crow)));
+                _mm256_storeu_ps(crow + 8, _mm256_fmadd_ps(al, acc[r][1], _mm256_loadu_ps(crow + 8)));
+            } else {
+                _mm256_storeu_ps(crow, _mm256_mul_ps(al, acc[r][0]));
+                _mm256_storeu_ps(crow + 8, _mm256_mul_ps(al, acc[r][1]));
+            }
+        }
+        return;
+    }
+    float tmp[GEMM_MR * GEMM_NR];
+    for (int r = 0; r < GEMM_MR; ++r) { _mm256_storeu_ps(tmp + r * GEMM_NR, acc[r][0]); _mm256_storeu_ps(tmp + r * GEMM_NR + 8, acc[r][1]); }
+    zapisz_kafelek(tmp, c, ldc, alpha, akumuluj, mr, nr);
+}
+// Double: kafelek 6x8 = 12 akumulatorow ymm, jak we float.
+__attribute__((target("avx2,fma")))
+static void mikrojadro_d_avx2(int kc, const double *ap, const double *bp, double *c, long ldc,
+                              double alpha, int akumuluj, int mr, int nr) {
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd(), c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd(), c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd(), c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+    for (int k = 0; k < kc; ++k) {
+        __m256d b0 = _mm256_load_pd(bp), b1 = _mm256_load_pd(bp + 4);
+        __m256d av;
+        av = _mm256_broadcast_sd(ap + 0); c00 = _mm256_fmadd_pd(av, b0, c00); c01 = _mm256_fmadd_pd(av, b1, c01);
+        av = _mm256_broadcast_sd(ap + 1); c10 = _mm256_fmadd_pd(av, b0, c10); c11 = _mm256_fmadd_pd(av, b1, c11);
+        av = _mm256_broadcast_sd(ap + 2); c20 = _mm256_fmadd_pd(av, b0, c20); c21 = _mm256_fmadd_pd(av, b1, c21);
+        av = _mm256_broadcast_sd(ap + 3); c30 = _mm256_fmadd_pd(av, b0, c30); c31 = _mm256_fmadd_pd(av, b1, c31);
+        av = _mm256_broadcast_sd(ap + 4); c40 = _mm256_fmadd_pd(av, b0, c40); c41 = _mm256_fmadd_pd(av, b1, c41);
+        av = _mm256_broadcast_sd(ap + 5); c50 = _mm256_fmadd_pd(av, b0, c50); c51 = _mm256_fmadd_pd(av, b1, c51);
+        ap += GEMM_MR_D; bp += GEMM_NR_D;
+    }
+    __m256d acc[GEMM_MR_D][2] = { { c00, c01 }, { c10, c11 }, { c20, c21 }, { c30, c31 }, { c40, c41 }, { c50, c51 } };
+    double tmp[GEMM_MR_D * GEMM_NR_D];
+    for (int r = 0; r < GEMM_MR_D; ++r) { _mm256_storeu_pd(tmp + r * GEMM_NR_D, acc[r][0]); _mm256_storeu_pd(tmp + r * GEMM_NR_D + 4, acc[r][1]); }
+    zapisz_kafelek_d(tmp, c, ldc, alpha, akumuluj, mr, nr);
+}
+// Mnozenie zespolone na danych przeplatanych: fmaddsub(re(alfa), x, im(alfa) * swap(x))
+// daje w parzystych pozycjach ar*xr - ai*xi, a w nieparzystych ar*xi + ai*xr.
+__attribute__((target("avx2,fma")))
+static void caxpy_avx2(size_t n, Complex alfa, const Complex *x, Complex *y) {
+    const __m256 ar = _mm256_set1_ps(alfa.re), ai = _mm256_set1_ps(alfa.im);
+    float *yf = (float *)y; const float *xf = (const float *)x;
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        __m256 xv = _mm256_loadu_ps(xf + 2 * j);
+        __m256 xs = _mm256_permute_ps(xv, _MM_SHUFFLE(2, 3, 0, 1));
+        __m256 p = _mm256_fmaddsub_ps(ar, xv, _mm256_mul_ps(ai, xs));
+        _mm256_storeu_ps(yf + 2 * j, _mm256_add_ps(_mm256_loadu_ps(yf + 2 * j), p));
+    }
+    caxpy_skalar(n - j, alfa, x + j, y + j);
+}
+__attribute__((target("avx2,fma")))
+static void transp_f32_avx2(const void *src, long lds, void *dst, long ldd) {
+    const float *a = src; float *b = dst;
+    __m256 r[8], t[8];
+    for (int i = 0; i < 8; ++i) r[i] = _mm256_loadu_ps(a + i * lds);
+    for (int i = 0; i < 8; i += 2) { t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]); t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]); }
+    for (int i = 0; i < 8; i += 4) {
+        r[i]     = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+        r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+        r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+        r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+    }
+    for (int i = 0; i < 4; ++i) {
+        _mm256_storeu_ps(b + i * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x20));
+        _mm256_storeu_ps(b + (i + 4) * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x31));
+    }
+}
+__attribute__((target("avx2,fma")))
+static void transp_c32_avx2(const void *src, long lds, void *dst, long ldd) {
+    const double *a = src; double *b = dst;
+    __m256d r0 = _mm256_loadu_pd(a), r1 = _mm256_loadu_pd(a + lds), r2 = _mm256_loadu_pd(a + 2 * lds), r3 = _mm256_loadu_pd(a + 3 * lds);
+    __m256d t0 = _mm256_unpacklo_pd(r0, r1), t1 = _mm256_unpackhi_pd(r0, r1);
+    __m256d t2 = _mm256_unpacklo_pd(r2, r3), t3 = _mm256_unpackhi_pd(r2, r3);
+    _mm256_storeu_pd(b, _mm256_permute2f128_pd(t0, t2, 0x20));
+    _mm256_storeu_pd(b + ldd, _mm256_permute2f128_pd(t1, t3, 0x20));
+    _mm256_storeu_pd(b + 2 * ldd, _mm256_permute2f128_pd(t0, t2, 0x31));
+    _mm256_storeu_pd(b + 3 * ldd, _mm256_permute2f128_pd(t1, t3, 0x31));
+}
+
+// AVX-512: caly pasek NR = 16 miesci sie w jednym rejestrze zmm; ogony przez maski.
+__attribute__((target("avx512f")))
+static void dodaj_avx512(const float *a, const float *b, float *w, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) _mm512_storeu_ps(w + i, _mm512_add_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+    if (i < n) {
+        __mmask16 m = (__mmask16)((1u << (n - i)) - 1);
+        _mm512_mask_storeu_ps(w + i, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i)));
+    }
+}
+__attribute__((target("avx512f")))
+static void odejmij_avx512(const float *a, const float *b, float *w, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) _mm512_storeu_ps(w + i, _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+    if (i < n) {
+        __mmask16 m = (__mmask16)((1u << (n - i)) - 1);
+        _mm512_mask_storeu_ps(w + i, m, _mm512_sub_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i)));
+    }
+}
+__attribute__((target("avx512f")))
+static void mikrojadro_avx512(int kc, const float *ap, const float *bp, float *c, long ldc,
+                              float alpha, int akumuluj, int mr, int nr) {
+    __m512 c0 = _mm512_setzero_ps(), c1 = _mm512_setzero_ps(), c2 = _mm512_setzero_ps();
+    __m512 c3 = _mm512_setzero_ps(), c4 = _mm512_setzero_ps(), c5 = _mm512_setzero_ps();
+    for (int k = 0; k < kc; ++k) {
+        __m512 b0 = _mm512_load_ps(bp);
+        c0 = _mm512_fmadd_ps(_mm512_set1_ps(ap[0]), b0, c0);
+        c1 = _mm512_fmadd_ps(_mm512_set1_ps(ap[1]), b0, c1);
+        c2 = _mm512_fmadd_ps(_mm512_set1_ps(ap[2]), b0, c2);
+        c3 = _mm512_fmadd_ps(_mm512_set1_ps(ap[3]), b0, c3);
+        c4 = _mm512_fmadd_ps(_mm512_set1_ps(ap[4]), b0, c4);
+        c5 = _mm512_fmadd_ps(_mm512_set1_ps(ap[5]), b0, c5);
+        ap += GEMM_MR; bp += GEMM_NR;
+    }
+    __m512 acc[GEMM_MR] = { c0, c1, c2, c3, c4, c5 };
+    __m512 al = _mm512_set1_ps(alpha);
+    __mmask16 m = (__mmask16)(nr == GEMM_NR ? 0xFFFFu : (1u << nr) - 1);
+    for (int r = 0; r < mr; ++r) {
+        float *crow = c + (long)r * ldc;
+        __m512 v = akumuluj ? _mm512_fmadd_ps(al, acc[r], _mm512_maskz_loadu_ps(m, crow)) : _mm512_mul_ps(al, acc[r]);
+        _mm512_mask_storeu_ps(crow, m, v);
+    }
+}
+__attribute__((target("avx512f")))
+static void mikrojadro_d_avx512(int kc, const double *ap, const double *bp, double *c, long ldc,
+                                double alpha, int akumuluj, int mr, int nr) {
+    __m512d c0 = _mm512_setzero_pd(), c1 = _mm512_setzero_pd(), c2 = _mm512_setzero_pd();
+    __m512d c3 = _mm512_setzero_pd(), c4 = _mm512_setzero_pd(), c5 = _mm512_setzero_pd();
+    for (int k = 0; k < kc; ++k) {
+        __m512d b0 = _mm512_load_pd(bp);
+        c0 = _mm512_fmadd_pd(_mm512_set1_pd(ap[0]), b0, c0);
+        c1 = _mm512_fmadd_pd(_mm512_set1_pd(ap[1]), b0, c1);
+        c2 = _mm512_fmadd_pd(_mm512_set1_pd(ap[2]), b0, c2);
+        c3 = _mm512_fmadd_pd(_mm512_set1_pd(ap[3]), b0, c3);
+        c4 = _mm512_fmadd_pd(_mm512_set1_pd(ap[4]), b0, c4);
+        c5 = _mm512_fmadd_pd(_mm512_set1_pd(ap[5]), b0, c5);
+        ap += GEMM_MR_D; bp += GEMM_NR_D;
+    }
+    __m512d acc[GEMM_MR_D] = { c0, c1, c2, c3, c4, c5 };
+    __m512d al = _mm512_set1_pd(alpha);
+    __mmask8 m = (__mmask8)(nr == GEMM_NR_D ? 0xFFu : (1u << nr) - 1);
+    for (int r = 0; r < mr; ++r) {
+        double *crow = c + (long)r * ldc;
+        __m512d v = akumuluj ? _mm512_fmadd_pd(al, acc[r], _mm512_maskz_loadu_pd(m, crow)) : _mm512_mul_pd(al, acc[r]);
+        _mm512_mask_storeu_pd(crow, m, v);
+    }
+}
+__attribute__((target("avx512f")))
+static void caxpy_avx512(size_t n, Complex alfa, const Complex *x, Complex *y) {
+    const __m512 ar = _mm512_set1_ps(alfa.re), ai = _mm512_set1_ps(alfa.im);
+    float *yf = (float *)y; const float *xf = (const float *)x;
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8) {
+        __m512 xv = _mm512_loadu_ps(xf + 2 * j);
+        __m512 xs = _mm512_permute_ps(xv, _MM_SHUFFLE(2, 3, 0, 1));
+        __m512 p = _mm512_fmaddsub_ps(ar, xv, _mm512_mul_ps(ai, xs));
+        _mm512_storeu_ps(yf + 2 * j, _mm512_add_ps(_mm512_loadu_ps(yf + 2 * j), p));
+    }
+    caxpy_skalar(n - j, alfa, x + j, y + j);
+}
+// Kafelek 16x16: przeplot par wierszy, potem czworki w obrebie 128 bitow, na koniec dwa
+// przetasowania calych 128-bitowych czesci miedzy rejestrami.
+__attribute__((target("avx512f")))
+static void transp_f32_avx512(const void *src, long lds, void *dst, long ldd) {
+    const float *a = src; float *b = dst;
+    __m512 r[16], t[16];
+    for (int i = 0; i < 16; ++i) r[i] = _mm512_loadu_ps(a + i * lds);
+    for (int i = 0; i < 16; i += 2) { t[i] = _mm512_unpacklo_ps(r[i], r[i + 1]); t[i + 1] = _mm512_unpackhi_ps(r[i], r[i + 1]); }
+    // r[4g + c]: wiersze 4g..4g+3 kolumn c, c+4, c+8, c+12
+    for (int g = 0; g < 16; g += 4) {
+        r[g]     = _mm512_shuffle_ps(t[g], t[g + 2], _MM_SHUFFLE(1, 0, 1, 0));
+        r[g + 1] = _mm512_shuffle_ps(t[g], t[g + 2], _MM_SHUFFLE(3, 2, 3, 2));
+        r[g + 2] = _mm512_shuffle_ps(t[g + 1], t[g + 3], _MM_SHUFFLE(1, 0, 1, 0));
+        r[g + 3] = _mm512_shuffle_ps(t[g + 1], t[g + 3], _MM_SHUFFLE(3, 2, 3, 2));
+    }
+    for (int c = 0; c < 4; ++c) {
+        __m512 v0 = _mm512_shuffle_f32x4(r[c], r[c + 4], 0x88), w0 = _mm512_shuffle_f32x4(r[c], r[c + 4], 0xDD);
+        __m512 v1 = _mm512_shuffle_f32x4(r[c + 8], r[c + 12], 0x88), w1 = _mm512_shuffle_f32x4(r[c + 8], r[c + 12], 0xDD);
+        _mm512_storeu_ps(b + c * ldd, _mm512_shuffle_f32x4(v0, v1, 0x88));
+        _mm512_storeu_ps(b + (c + 8) * ldd, _mm512_shuffle_f32x4(v0, v1, 0xDD));
+        _mm512_storeu_ps(b + (c + 4) * ldd, _mm512_shuffle_f32x4(w0, w1, 0x88));
+        _mm512_storeu_ps(b + (c + 12) * ldd, _mm512_shuffle_f32x4(w0, w1, 0xDD));
+    }
+}
+__attribute__((target("avx512f")))
+static void transp_c32_avx512(const void *src, long lds, void *dst, long ldd) {
+    const double *a = src; double *b = dst;
+    __m512d r[8], t[8];
+    for (int i = 0; i < 8; ++i) r[i] = _mm512_loadu_pd(a + i * lds);
+    for (int i = 0; i < 8; i += 2) { t[i] = _mm512_unpacklo_pd(r[i], r[i + 1]); t[i + 1] = _mm512_unpackhi_pd(r[i], r[i + 1]); }
+    // r[4g + c]: wiersze 4g..4g+3 kolumn c i c+4 (c = 0..3)
+    for (int g = 0; g < 8; g += 4) {
+        r[g]     = _mm512_shuffle_f64x2(t[g], t[g + 2], 0x88);
+        r[g + 1] = _mm512_shuffle_f64x2(t[g + 1], t[g + 3], 0x88);
+        r[g + 2] = _mm512_shuffle_f64x2(t[g], t[g + 2], 0xDD);
+        r[g + 3] = _mm512_shuffle_f64x2(t[g + 1], t[g + 3], 0xDD);
+    }
+    for (int c = 0; c < 4; ++c) {
+        _mm512_storeu_pd(b + c * ldd, _mm512_shuffle_f64x2(r[c], r[c + 4], 0x88));
+        _mm512_storeu_pd(b + (c + 4) * ldd, _mm512_shuffle_f64x2(r[c], r[c + 4], 0xDD));
+    }
+}
+#endif
+
+// Aktywny zestaw jader; domyslnie skalarny, zeby funkcje byly uzywalne jeszcze przed wyborem.
+static struct {
+    const char *nazwa;
+    jadro_ew_t dodaj, odejmij;
+    jadro_mikro_t mikro;
+    jadro_mikro_d_t mikro_d;
+    jadro_caxpy_t caxpy;
+    jadro_transp_t transp_f, transp_c;
+    int tr_f, tr_c;
+} jadra = { "scalar", dodaj_skalar, odejmij_skalar, mikrojadro_skalar, mikrojadro_d_skalar, caxpy_skalar, transp_f32_skalar, transp_c32_skalar, 8, 4 };
+
+// Ustawia zestaw jader o danej nazwie (scalar, sse2, avx2, avx512); 1, gdy procesor go nie obsluguje.
+static int ustaw_jadra(const char *nazwa) {
+    if (strcmp(nazwa, "scalar") == 0) {
+        jadra.nazwa = "scalar"; jadra.dodaj = dodaj_skalar; jadra.odejmij = odejmij_skalar;
+        jadra.mikro = mikrojadro_skalar; jadra.mikro_d = mikrojadro_d_skalar; jadra.caxpy = caxpy_skalar;
+        jadra.transp_f = transp_f32_skalar; jadra.transp_c = transp_c32_skalar; jadra.tr_f = 8; jadra.tr_c = 4;
+        return 0;
+    }
+#ifdef JADRA_X86
+    __builtin_cpu_init();
+    if (strcmp(nazwa, "avx512") == 0 && __builtin_cpu_supports("avx512f")) {
+        jadra.nazwa = "avx512"; jadra.dodaj = dodaj_avx512; jadra.odejmij = odejmij_avx512;
+        jadra.mikro = mikrojadro_avx512; jadra.mikro_d = mikrojadro_d_avx512; jadra.caxpy = caxpy_avx512;
+        jadra.transp_f = transp_f32_avx512; jadra.transp_c = transp_c32_avx512; jadra.tr_f = 16; jadra.tr_c = 8;
+        return 0;
+    }
+    if (strcmp(nazwa, "avx2") == 0 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        jadra.nazwa = "avx2"; jadra.dodaj = dodaj_avx2; jadra.odejmij = odejmij_avx2;
+        jadra.mikro = mikrojadro_avx2; jadra.mikro_d = mikrojadro_d_avx2; jadra.caxpy = caxpy_avx2;
+        jadra.transp_f = transp_f32_avx2; jadra.transp_c = transp_c32_avx2; jadra.tr_f = 8; jadra.tr_c = 4;
+        return 0;
+    }
+    if (strcmp(nazwa, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        jadra.nazwa = "sse2"; jadra.dodaj = dodaj_sse2; jadra.odejmij = odejmij_sse2;
+        jadra.mikro = mikrojadro_sse2; jadra.mikro_d = mikrojadro_d_sse2; jadra.caxpy = caxpy_sse2;
+        jadra.transp_f = transp_f32_sse2; jadra.transp_c = transp_c32_sse2; jadra.tr_f = 4; jadra.tr_c = 2;
+        return 0;
+    }
+#endif
+    return 1;
+}
+// Wybiera najlepszy zestaw jader dla biezacego procesora (CPUID). Zmienna srodowiskowa
+// CALC_SIMD=scalar|sse2|avx2|avx512 pozwala ograniczyc wybor, np. do porownan.
+static void wybierz_jadra(void) {
+    static const char *kolejnosc[] = { "avx512", "avx2", "sse2" };
+    const char *limit = getenv("CALC_SIMD");
+    if (limit && strcmp(limit, "scalar") == 0) return;
+    int od = !limit || strcmp(limit, "avx512") == 0 ? 0 : strcmp(limit, "avx2") == 0 ? 1 : 2;
+    for (int i = od; i < 3; ++i)
+        if (ustaw_jadra(kolejnosc[i]) == 0) return;
+}
+
+// --- Pula watkow z podkradaniem pracy ---
+// Zadanie rownolegle to zakres indeksow [0, n). Kazdy watek dostaje ciagly kawalek we wlasnej
+// kolejce i zdejmuje z niej zadania od poczatku; gdy skonczy, podkrada polowe cudzej kolejki od konca.
+// Wynik zadania zalezy tylko od jego indeksu, wiec wyniki nie zaleza od liczby watkow.
+typedef void (*zadanie_fn)(void *ctx, long i);
+
+typedef struct {
+    pthread_mutex_t mutex;
+    long lo, hi;
+    char wypelnienie[64];
+} KolejkaZadan;
+
+static struct {
+    int n;                      // liczba watkow razem z watkiem glownym
+    pthread_t *watki;
+    KolejkaZadan *kolejki;
+    pthread_mutex_t mutex, zlecenie;
+    pthread_cond_t start, koniec;
+    unsigned long pokolenie;
+    int aktywne;
+    zadanie_fn fn;
+    void *ctx;
+} pula = { 1, NULL, NULL, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+           PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, NULL, NULL };
+static __thread int w_puli = 0;
+
+static int wez_zadanie(int id, long *pi) {
+    KolejkaZadan *q = &pula.kolejki[id];
+    pthread_mutex_lock(&q->mutex);
+    int ok = q->lo < q->hi;
+    if (ok) *pi = q->lo++;
+    pthread_mutex_unlock(&q->mutex);
+    if (ok) return 1;
+    for (int d = 1; d < pula.n; ++d) {
+        KolejkaZadan *ofiara = &pula.kolejki[(id + d) % pula.n];
+        pthread_mutex_lock(&ofiara->mutex);
+        long ile = ofiara->hi - ofiara->lo;
+        long lo = 0, hi = 0;
+        if (ile > 0) { hi = ofiara->hi; lo = hi - (ile + 1) / 2; ofiara->hi = lo; }
+        pthread_mutex_unlock(&ofiara->mutex);
+        if (ile > 0) {
+            *pi = lo;
+            if (hi - lo > 1) {
+                pthread_mutex_lock(&q->mutex);
+                q->lo = lo + 1; q->hi = hi;
+                pthread_mutex_unlock(&q->mutex);
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+static void pracuj(int id) {
+    long i;
+    while (wez_zadanie(id, &i)) pula.fn(pula.ctx, i);
+    pthread_mutex_lock(&pula.mutex);
+    if (--pula.aktywne == 0) pthread_cond_signal(&pula.koniec);
+    pthread_mutex_unlock(&pula.mutex);
+}
+static void *watek_puli(void *arg) {
+    int id = (int)(long)arg;
+    unsigned long widziane = 0;
+    w_puli = 1;
+    for (;;) {
+        pthread_mutex_lock(&pula.mutex);
+        while (pula.pokolenie == widziane) pthread_cond_wait(&pula.start, &pula.mutex);
+        widziane = pula.pokolenie;
+        pthread_mutex_unlock(&pula.mutex);
+        pracuj(id);
+    }
+    return NULL;
+}
+// Tworzy n - 1 watkow roboczych (watek glowny tez liczy). Przy bledzie zostaje mniej watkow.
+static void uruchom_pule(int n) {
+    if (n < 1) n = 1;
+    pula.kolejki = calloc((size_t)n, sizeof(KolejkaZadan));
+    pula.watki = calloc((size_t)n, sizeof(pthread_t));
+    if (!pula.kolejki || !pula.watki) { free(pula.kolejki); free(pula.watki); pula.kolejki = NULL; pula.watki = NULL; return; }
+    for (int i = 0; i < n; ++i) pthread_mutex_init(&pula.kolejki[i].mutex, NULL);
+    int utworzone = 1;
+    for (int i = 1; i < n; ++i) {
+        if (pthread_create(&pula.watki[i], NULL, watek_puli, (void *)(long)i) != 0) break;
+        pthread_detach(pula.watki[i]);
+        utworzone++;
+    }
+    pula.n = utworzone;
+}
+// Wykonuje fn(ctx, i) dla i z [0, n) na wszystkich watkach puli i czeka na koniec.
+// Wywolanie z wnetrza zadania (lub bez puli) liczy sekwencyjnie.
+static void rownolegle(long n, zadanie_fn fn, void *ctx) {
+    if (n <= 0) return;
+    if (pula.n <= 1 || n == 1 || w_puli) {
+        for (long i = 0; i < n; ++i) fn(ctx, i);
+        return;
+    }
+    pthread_mutex_lock(&pula.zlecenie);
+    for (int t = 0; t < pula.n; ++t) {
+        pula.kolejki[t].lo = n * t / pula.n;
+        pula.kolejki[t].hi = n * (t + 1) / pula.n;
+    }
+    pthread_mutex_lock(&pula.mutex);
+    pula.fn = fn; pula.ctx = ctx;
+    pula.aktywne = pula.n;
+    pula.pokolenie++;
+    pthread_cond_broadcast(&pula.start);
+    pthread_mutex_unlock(&pula.mutex);
+    w_puli = 1;
+    pracuj(0);
+    w_puli = 0;
+    pthread_mutex_lock(&pula.mutex);
+    while (pula.aktywne > 0) pthread_cond_wait(&pula.koniec, &pula.mutex);
+    pthread_mutex_unlock(&pula.mutex);
+    pthread_mutex_unlock(&pula.zlecenie);
+}
+
+// Operacje elementowe dzielone na ciagle zakresy elementow (kolejne wiersze); kazdy element
+// liczony tak samo jak sekwencyjnie.
+#define EW_ZAKRES 65536
+typedef struct { jadro_ew_t f; const float *a, *b; float *w; size_t n; } ZadanieEw;
+static void zadanie_ew(void *ctx, long i) {
+    ZadanieEw *z = ctx;
+    size_t lo = (size_t)i * EW_ZAKRES, hi = lo + EW_ZAKRES < z->n ? lo + EW_ZAKRES : z->n;
+    z->f(z->a + lo, z->b + lo, z->w + lo, hi - lo);
+}
+static void ew_rownolegle(jadro_ew_t f, const float *a, const float *b, float *w, size_t n) {
+    ZadanieEw z = { f, a, b, w, n };
+    rownolegle((long)((n + EW_ZAKRES - 1) / EW_ZAKRES), zadanie_ew, &z);
+}
+
+// --- Statystyki (--stats) ---
+// Czas fazy mierzony jest w watku, ktory wlaczyl statystyki: faza_wejdz() dolicza czas od ostatniej
+// zmiany do biezacej fazy i przelacza na nowa. Wszystko poza wczytywaniem i zapisem liczy sie jako
+// obliczenia. Bajty i operacje zmiennoprzecinkowe (nominalne, np. 2mkn dla iloczynu) liczone zawsze.
+enum { FAZA_OBLICZENIA, FAZA_TYP, FAZA_WCZYTYWANIE, FAZA_WYPISYWANIE, FAZA_ZAPIS, FAZ };
+static struct {
+    int wlaczone, faza;
+    pthread_t watek;
+    double start, t0, czas[FAZ], flop;
+    unsigned long przeczytane, zapisane;
+} statystyki;
+
+static double czas_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+// Zwraca poprzednia faze dla faza_wyjdz (-1, gdy statystyki nie dotycza tego watku).
+static int faza_wejdz(int f) {
+    if (!statystyki.wlaczone || !pthread_equal(pthread_self(), statystyki.watek)) return -1;
+    double t = czas_s();
+    int poprz = statystyki.faza;
+    statystyki.czas[poprz] += t - statystyki.t0;
+    statystyki.t0 = t;
+    statystyki.faza = f;
+    return poprz;
+}
+static void faza_wyjdz(int poprz) { if (poprz >= 0) faza_wejdz(poprz); }
+static void dolicz_flop(double flop) {
+    if (statystyki.wlaczone && pthread_equal(pthread_self(), statystyki.watek)) statystyki.flop += flop;
+}
+static void dolicz_bajty(unsigned long *licznik, size_t n) { __atomic_fetch_add(licznik, (unsigned long)n, __ATOMIC_RELAXED); }
+static void wypisz_statystyki(void) {
+    faza_wejdz(FAZA_OBLICZENIA);
+    static const char *nazwy[FAZ] = { "obliczenia", "wykrywanie typu", "wczytywanie", "wypisywanie", "zapis" };
+    static const int kolejnosc[FAZ] = { FAZA_TYP, FAZA_WCZYTYWANIE, FAZA_OBLICZENIA, FAZA_WYPISYWANIE, FAZA_ZAPIS };
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    fprintf(stderr, "Statystyki:\n");
+    for (int i = 0; i < FAZ; ++i) {
+        int f = kolejnosc[i];
+        fprintf(stderr, "  %-16s %10.4f s", nazwy[f], statystyki.czas[f]);
+        if (f == FAZA_OBLICZENIA && statystyki.flop > 0 && statystyki.czas[f] > 0)
+            fprintf(stderr, "   %.2f GFLOP/s", statystyki.flop / statystyki.czas[f] * 1e-9);
+        fprintf(stderr, "\n");
+    }
+    fprintf(stderr, "  %-16s %10.4f s\n", "razem", czas_s() - statystyki.start);
+    fprintf(stderr, "  przeczytano %.2f MB, zapisano %.2f MB, szczytowe RSS %.1f MB\n",
+            statystyki.przeczytane / (1024.0 * 1024.0), statystyki.zapisane / (1024.0 * 1024.0), ru.ru_maxrss / 1024.0);
+}
+static void wlacz_statystyki(void) {
+    if (statystyki.wlaczone) return;
+    statystyki.wlaczone = 1;
+    statystyki.watek = pthread_self();
+    statystyki.start = statystyki.t0 = czas_s();
+    atexit(wypisz_statystyki);
+}
+
+// --- Szybkie parsowanie liczb ---
+// Parser dziala bezposrednio na buforze wejsciowym (zakres [s, e)), bez kopiowania tokenow.
+// Szybka sciezka obsluguje zapis dziesietny; wszystko inne (hex, inf, nan, bardzo dlugie
+// mantysy) konczy sie kopia do malego bufora i strtof, wiec akceptowana skladnia jest ta sama.
+static inline int bialy_znak(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+static const double potegi_10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+static const float potegi_10f[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+// Szybka sciezka: zwraca wskaznik za liczba albo NULL, gdy trzeba zapytac strtof.
+// Mantysa <= 2^53 i |wykladnik| <= 22 daja w double wynik poprawnie zaokraglony (Clinger);
+// zaokraglenie do float jest wtedy poprawne, o ile double nie trafil dokladnie w polowe
+// miedzy dwoma floatami - ten jeden przypadek oddajemy strtof.
+static const char *parsuj_float_szybko(const char *s, const char *e, float *out) {
+    const char *p = s;
+    int ujemna = 0;
+    if (p < e && (*p == '+' || *p == '-')) { ujemna = (*p == '-'); p++; }
+    const char *pocz = p;
+    while (p < e && *p == '0') p++;
+    if (p < e && (*p == 'x' || *p == 'X') && p > pocz) return NULL;
+    // Cyfry znaczace zbieramy bez sprawdzania przepelnienia; ponad 19 cyfr idzie do strtof.
+    unsigned long long m = 0;
+    const char *cyfry = p;
+    while (p < e && (unsigned)(*p - '0') < 10) { m = m * 10 + (unsigned)(*p - '0'); p++; }
+    long n = p - cyfry;
+    int wykl = 0, jakiekolwiek = p > pocz;
+    if (p < e && *p == '.') {
+        const char *ulamek = ++p;
+        if (n == 0) while (p < e && *p == '0') p++;
+        const char *cz = p;
+        while (p < e && (unsigned)(*p - '0') < 10) { m = m * 10 + (unsigned)(*p - '0'); p++; }
+        n += p - cz;
+        wykl = -(int)(p - ulamek);
+        jakiekolwiek |= p > ulamek;
+    }
+    if (!jakiekolwiek || n > 19) return NULL;
+    if (p < e && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        int ujemny_wykl = 0, w = 0, wcyfry = 0;
+        if (q < e && (*q == '+' || *q == '-')) { ujemny_wykl = (*q == '-'); q++; }
+        while (q < e && (unsigned)(*q - '0') < 10) {
+            if (++wcyfry > 4) return NULL;
+            w = w * 10 + (*q - '0'); q++;
+        }
+        if (wcyfry == 0) return NULL;
+        wykl += ujemny_wykl ? -w : w;
+        p = q;
+    }
+    if (m == 0) { *out = ujemna ? -0.0f : 0.0f; return p; }
+    if (m <= (1ULL << 24) && wykl >= -10 && wykl <= 10) {
+        // Obie wartosci dokladne we float - jedno zaokraglenie daje poprawny wynik.
+        float f = (float)m;
+        f = wykl < 0 ? f / potegi_10f[-wykl] : f * potegi_10f[wykl];
+        *out = ujemna ? -f : f;
+        return p;
+    }
+    if (m > (1ULL << 53) || wykl < -22 || wykl > 22) return NULL;
+    double d = (double)m;
+    d = wykl < 0 ? d / potegi_10[-wykl] : d * potegi_10[wykl];
+    unsigned long long bity;
+    memcpy(&bity, &d, sizeof(bity));
+    if ((bity & 0x1FFFFFFFULL) == 0x10000000ULL) return NULL;
+    float f = (float)d;
+    *out = ujemna ? -f : f;
+    return p;
+}
+// Kopia zakresu do bufora zakonczonego zerem dla wolnej sciezki (male tokeny - na stosie).
+#define TOKEN_STOS 64
+static char *kopiuj_token(const char *s, const char *e, char *stos) {
+    size_t n = (size_t)(e - s);
+    char *t = n < TOKEN_STOS ? stos : malloc(n + 1);
+    if (!t) return NULL;
+    memcpy(t, s, n); t[n] = '\0';
+    return t;
+}
+// Parsuje liczbe z [s, e) semantyka strtof (bez pomijania wiodacych bialych znakow).
+// Zwraca koniec liczby (s, gdy jej brak); *erange = 1 przy przekroczeniu zakresu.
+static const char *parsuj_float(const char *s, const char *e, float *out, int *erange) {
+    *erange = 0;
+    const char *p = parsuj_float_szybko(s, e, out);
+    if (p) return p;
+    char stos[TOKEN_STOS];
+    char *t = kopiuj_token(s, e, stos);
+    if (!t) return s;
+    char *end;
+    errno = 0;
+    *out = strtof(t, &end);
+    *erange = (errno == ERANGE);
+    p = s + (end - t);
+    if (t != stos) free(t);
+    return p;
+}
+
+// Token liczbowy wiersza od p (wiersz konczy sie w e); tokeny rozdziela tabulator.
+// Zwraca poczatek nastepnego tokenu, a w *kod 0 albo kod bledu wczytywania (5, 6, 7).
+// Zwykle wystarcza jedno przejscie: liczba, spacje i od razu separator.
+static const char *token_float(const char *p, const char *e, float *out, int *kod) {
+    const char *start = p;
+    while (start < e && bialy_znak(*start) && *start != '\t' && *start != '\n' && *start != '\r') start++;
+    const char *q = parsuj_float_szybko(start, e, out);
+    if (q) {
+        while (q < e && (*q == ' ' || *q == '\v' || *q == '\f')) q++;
+        if (q == e || *q == '\t' || *q == '\n' || *q == '\r') {
+            *kod = 0;
+            return (q < e && *q == '\t') ? q + 1 : q;
+        }
+    }
+    const char *end = start;
+    while (end < e && *end != '\t' && *end != '\n' && *end != '\r') end++;
+    const char *nastepny = (end < e && *end == '\t') ? end + 1 : end;
+    while (end > start && bialy_znak(end[-1])) end--;
+    if (start == end) { *kod = 5; return nastepny; }
+    int erange;
+    if (parsuj_float(start, end, out, &erange) != end) { *kod = 6; return nastepny; }
+    *kod = erange ? 7 : 0;
+    return nastepny;
+}
+
+// --- Zrodla danych wejsciowych ---
+// Zwykly plik jest mapowany w calosci (mmap + MADV_SEQUENTIAL) i parsowany w miejscu, bez
+// kopiowania przez bufory stdio i bez limitu dlugosci wiersza. Potoki i stdin ("-") czytane sa
+// strumieniowo wlasnym buforem, ktory rosnie do dlugosci najdluzszego wiersza.
+#define ZRODLO_BLOK (1 << 20)
+typedef struct {
+    const char *dane;           // zmapowany plik (NULL dla strumienia)
+    size_t rozmiar, poz;
+    int fd;                     // strumien dla potokow i stdin
+    char *buf;
+    size_t buf_poz, buf_dl, buf_cap;
+    int eof;
+} Zrodlo;
+
+static int otworz_zrodlo(Zrodlo *z, const char *nazwa) {
+    memset(z, 0, sizeof(*z));
+    z->fd = -1;
+    if (strcmp(nazwa, "-") == 0) { z->fd = STDIN_FILENO; return 0; }
+    int fd = open(nazwa, O_RDONLY);
+    if (fd < 0) return 1;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        z->rozmiar = (size_t)st.st_size;
+        if (z->rozmiar == 0) { close(fd); z->dane = ""; return 0; }
+        // PROT_WRITE na mapowaniu prywatnym nic nie kosztuje, a pozwala modyfikowac dane
+        // wczytane bez kopiowania (kopia przy zapisie).
+        void *m = mmap(NULL, z->rozmiar, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED) {
+            close(fd);
+            madvise(m, z->rozmiar, MADV_SEQUENTIAL);
+            dolicz_bajty(&statystyki.przeczytane, z->rozmiar);
+            z->dane = m;
+            return 0;
+        }
+    }
+    z->rozmiar = 0;
+    z->fd = fd;
+    return 0;
+}
+// Dla strumienia: dba, zeby w buforze bylo co najmniej n bajtow (mniej tylko na koncu danych).
+static size_t zrodlo_dostepne(Zrodlo *z, size_t n) {
+    while (z->buf_dl - z->buf_poz < n && !z->eof) {
+        if (z->buf_poz > 0) {
+            memmove(z->buf, z->buf + z->buf_poz, z->buf_dl - z->buf_poz);
+            z->buf_dl -= z->buf_poz; z->buf_poz = 0;
+        }
+        if (z->buf_cap - z->buf_dl < ZRODLO_BLOK) {
+            size_t cap = z->buf_cap ? z->buf_cap * 2 : 2 * ZRODLO_BLOK;
+            char *nb = realloc(z->buf, cap);
+            if (!nb) { z->eof = 1; break; }
+            z->buf = nb; z->buf_cap = cap;
+        }
+        ssize_t r = read(z->fd, z->buf + z->buf_dl, z->buf_cap - z->buf_dl);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) z->eof = 1;
+        else { z->buf_dl += (size_t)r; dolicz_bajty(&statystyki.przeczytane, (size_t)r); }
+    }
+    return z->buf_dl - z->buf_poz;
+}
+// Kolejny wiersz jako zakres [*ps, *pe) bez znaku nowej linii; 0 na koncu danych.
+static int nastepna_linia(Zrodlo *z, const char **ps, const char **pe) {
+    if (z->dane) {
+        if (z->poz >= z->rozmiar) return 0;
+        const char *s = z->dane + z->poz;
+        const char *nl = memchr(s, '\n', z->rozmiar - z->poz);
+        const char *e = nl ? nl : z->dane + z->rozmiar;
+        z->poz = (size_t)(e - z->dane) + (nl ? 1 : 0);
+        *ps = s; *pe = e;
+        return 1;
+    }
+    size_t przejrzane = 0;
+    for (;;) {
+        size_t dost = z->buf_dl - z->buf_poz;
+        const char *s = z->buf + z->buf_poz;
+        const char *nl = memchr(s + przejrzane, '\n', dost - przejrzane);
+        if (nl || z->eof) {
+            if (dost == 0) return 0;
+            const char *e = nl ? nl : s + dost;
+            z->buf_poz += (size_t)(e - s) + (nl ? 1 : 0);
+            *ps = s; *pe = e;
+            return 1;
+        }
+        przejrzane = dost;
+        zrodlo_dostepne(z, dost + 1);
+    }
+}
+// Kopiuje n kolejnych bajtow (dane binarne); zwraca liczbe skopiowanych.
+static size_t zrodlo_czytaj(Zrodlo *z, void *dst, size_t n) {
+    if (z->dane) {
+        size_t k = z->rozmiar - z->poz < n ? z->rozmiar - z->poz : n;
+        memcpy(dst, z->dane + z->poz, k);
+        z->poz += k;
+        return k;
+    }
+    size_t k = z->buf_dl - z->buf_poz < n ? z->buf_dl - z->buf_poz : n;
+    memcpy(dst, z->buf + z->buf_poz, k);
+    z->buf_poz += k;
+    while (k < n) {
+        ssize_t r = read(z->fd, (char *)dst + k, n - k);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        k += (size_t)r;
+        dolicz_bajty(&statystyki.przeczytane, (size_t)r);
+    }
+    return k;
+}
+static void zamknij_zrodlo(Zrodlo *z) {
+    if (z->dane && z->rozmiar) munmap((void *)z->dane, z->rozmiar);
+    if (z->fd >= 0 && z->fd != STDIN_FILENO) close(z->fd);
+    free(z->buf);
+    memset(z, 0, sizeof(*z));
+    z->fd = -1;
+}
+// --- Binarny format macierzy ---
+// Naglowek 64 B, potem surowe dane wierszami od przesuniecia wyrownanego do 64 B. Zwykly plik
+// jest mapowany i dane zwracane bez kopiowania; taki wskaznik zwalnia zwolnij_macierz().
+#define BIN_MAGIA "CMACIERZ"
+#define BIN_WERSJA 1
+#define BIN_KOLEJNOSC 0x01020304u
+#define BIN_WYROWNANIE 64
+// TYP_AUTO (tylko przy wczytywaniu): typ wynika z pliku, float jest rozszerzany przy pierwszej liczbie zespolonej.
+// TYP_F64 i TYP_C64 (--precision f64) istnieja tylko w pamieci i w tekscie; plik binarny jest zawsze float.
+enum { TYP_AUTO = 0, TYP_FLOAT = 1, TYP_COMPLEX = 2, TYP_F64 = 3, TYP_C64 = 4 };
+typedef struct {
+    char magia[8];
+    uint32_t wersja;
+    uint32_t typ;               // TYP_FLOAT albo TYP_COMPLEX
+    uint64_t wiersze, kolumny;
+    uint32_t wyrownanie;
+    uint32_t kolejnosc;         // BIN_KOLEJNOSC zapisane natywnie - wykrywa inna kolejnosc bajtow
+    uint64_t przesuniecie;      // poczatek danych od poczatku pliku
+    char zarezerwowane[16];
+} NaglowekBin;
+_Static_assert(sizeof(NaglowekBin) == 64, "naglowek binarny musi miec 64 bajty");
+
+// Macierze wczytane bez kopiowania wskazuja do mapowania pliku; rejestr pozwala je zwolnic.
+typedef struct { void *dane, *baza; size_t rozmiar; } Mapowanie;
+static struct {
+    Mapowanie *tab;
+    int n, cap;
+    pthread_mutex_t mutex;
+} mapowania = { NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+
+static int zarejestruj_mapowanie(void *dane, void *baza, size_t rozmiar) {
+    pthread_mutex_lock(&mapowania.mutex);
+    if (mapowania.n == mapowania.cap) {
+        int cap = mapowania.cap ? mapowania.cap * 2 : 8;
+        Mapowanie *t = realloc(mapowania.tab, (size_t)cap * sizeof(Mapowanie));
+        if (!t) { pthread_mutex_unlock(&mapowania.mutex); return 1; }
+        mapowania.tab = t; mapowania.cap = cap;
+    }
+    mapowania.tab[mapowania.n++] = (Mapowanie){ dane, baza, rozmiar };
+    pthread_mutex_unlock(&mapowania.mutex);
+    return 0;
+}
+void zwolnij_macierz(void *p) {
+    if (!p) return;
+    pthread_mutex_lock(&mapowania.mutex);
+    for (int i = 0; i < mapowania.n; ++i) {
+        if (mapowania.tab[i].dane == p) {
+            Mapowanie m = mapowania.tab[i];
+            mapowania.tab[i] = mapowania.tab[--mapowania.n];
+            pthread_mutex_unlock(&mapowania.mutex);
+            munmap(m.baza, m.rozmiar);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&mapowania.mutex);
+    free(p);
+}
+// Czy zrodlo zaczyna sie naglowkiem binarnym (nie przesuwa pozycji).
+static int zrodlo_binarne(Zrodlo *z) {
+    if (z->dane) return z->rozmiar >= sizeof(NaglowekBin) && memcmp(z->dane, BIN_MAGIA, 8) == 0;
+    return zrodlo_dostepne(z, 8) >= 8 && memcmp(z->buf + z->buf_poz, BIN_MAGIA, 8) == 0;
+}
+// Czyta i sprawdza naglowek binarny; zrodlo zostaje ustawione na poczatku danych.
+static int naglowek_binarny(Zrodlo *z, int typ, NaglowekBin *ph) {
+    NaglowekBin h;
+    if (zrodlo_czytaj(z, &h, sizeof(h)) != sizeof(h)) return 2;
+    if (h.wersja != BIN_WERSJA || h.kolejnosc != BIN_KOLEJNOSC) return 2;
+    if (h.typ != TYP_FLOAT && h.typ != TYP_COMPLEX) return 2;
+    if (h.wiersze == 0 || h.kolumny == 0 || h.wiersze > 0x7FFFFFFF || h.kolumny > 0x7FFFFFFF) return 3;
+    if (h.przesuniecie < sizeof(h) || h.przesuniecie % BIN_WYROWNANIE) return 2;
+    if (h.typ == TYP_COMPLEX && typ == TYP_FLOAT) return 9;
+    size_t n = (size_t)h.wiersze * h.kolumny;
+    size_t el = h.typ == TYP_COMPLEX ? sizeof(Complex) : sizeof(float);
+    // Rozmiar danych (takze po rozszerzeniu float -> Complex) musi sie miescic w size_t i w
+    // przesunieciach long; inaczej n * el przy czytaniu strumienia zawinalby sie do malej alokacji.
+    if (n > (size_t)PTRDIFF_MAX / sizeof(Complex)) return 3;
+    if (z->dane) {
+        if (h.przesuniecie > z->rozmiar || (z->rozmiar - h.przesuniecie) / el < n) return 8;
+        z->poz = (size_t)h.przesuniecie;
+    } else {
+        char pomin[BIN_WYROWNANIE];
+        size_t reszta = (size_t)h.przesuniecie - sizeof(h);
+        while (reszta > 0) {
+            size_t k = reszta < sizeof(pomin) ? reszta : sizeof(pomin);
+            if (zrodlo_czytaj(z, pomin, k) != k) return 8;
+            reszta -= k;
+        }
+    }
+    *ph = h;
+    return 0;
+}
+// Wczytuje macierz binarna. Gdy typ w pliku zgadza sie z oczekiwanym, a zrodlo jest mapowane,
+// dane nie sa kopiowane. float -> Complex jest rozszerzany; odwrotnie to blad 9. Przy *ptyp == TYP_AUTO
+// obowiazuje typ z naglowka; *ptyp dostaje typ wyniku.
+static int wczytaj_binarnie(Zrodlo *z, int *ptyp, void **pmat, int *prows, int *pcols) {
+    NaglowekBin h;
+    int kod = naglowek_binarny(z, *ptyp, &h);
+    if (kod) return kod;
+    int typ = *ptyp == TYP_AUTO ? (int)h.typ : *ptyp;
+    *ptyp = typ;
+    size_t n = (size_t)h.wiersze * h.kolumny;
+    size_t el = h.typ == TYP_COMPLEX ? sizeof(Complex) : sizeof(float);
+    void *mat;
+    if (z->dane && (int)h.typ == typ) {
+        mat = (void *)(z->dane + h.przesuniecie);
+        if (zarejestruj_mapowanie(mat, (void *)z->dane, z->rozmiar) != 0) return 4;
+        z->dane = NULL; z->rozmiar = 0;     // mapowanie przechodzi na macierz
+    } else {
+        mat = malloc(n * (typ == TYP_COMPLEX ? sizeof(Complex) : sizeof(float)));
+        if (!mat) return 4;
+        if ((int)h.typ == typ) {
+            if (zrodlo_czytaj(z, mat, n * el) != n * el) { free(mat); return 8; }
+        } else {
+            // float -> Complex: dane float laduja w drugiej polowie bufora i sa rozszerzane od poczatku.
+            float *f = (float *)((Complex *)mat + n) - n;
+            if (zrodlo_czytaj(z, f, n * sizeof(float)) != n * sizeof(float)) { free(mat); return 8; }
+            Complex *c = mat;
+            for (size_t i = 0; i < n; ++i) { float v = f[i]; c[i].re = v; c[i].im = 0.0f; }
+        }
+    }
+    *pmat = mat; *prows = (int)h.wiersze; *pcols = (int)h.kolumny;
+    return 0;
+}
+static void wypelnij_naglowek(NaglowekBin *h, int typ, int rows, int cols) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magia, BIN_MAGIA, 8);
+    h->wersja = BIN_WERSJA; h->typ = (uint32_t)typ;
+    h->wiersze = (uint64_t)rows; h->kolumny = (uint64_t)cols;
+    h->wyrownanie = BIN_WYROWNANIE; h->kolejnosc = BIN_KOLEJNOSC;
+    h->przesuniecie = sizeof(*h);
+}
+// Zapis naglowka i danych jednym wywolaniem writev (z dopisywaniem przy zapisie czesciowym).
+static int zapisz_binarnie(const char *filename, int typ, const void *mat, int rows, int cols) {
+    NaglowekBin h;
+    wypelnij_naglowek(&h, typ, rows, cols);
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return 1;
+    int f = faza_wejdz(FAZA_ZAPIS);
+    size_t rozmiar = (size_t)rows * cols * (typ == TYP_COMPLEX ? sizeof(Complex) : sizeof(float));
+    struct iovec iov[2] = { { &h, sizeof(h) }, { (void *)mat, rozmiar } };
+    int i = 0;
+    while (i < 2) {
+        ssize_t w = writev(fd, iov + i, 2 - i);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) { close(fd); faza_wyjdz(f); return 1; }
+        dolicz_bajty(&statystyki.zapisane, (size_t)w);
+        while (i < 2 && (size_t)w >= iov[i].iov_len) { w -= (ssize_t)iov[i].iov_len; i++; }
+        if (i < 2) { iov[i].iov_base = (char *)iov[i].iov_base + w; iov[i].iov_len -= (size_t)w; }
+    }
+    faza_wyjdz(f);
+    return close(fd) == 0 ? 0 : 1;
+}
+static int nazwa_binarna(const char *filename) {
+    size_t n = strlen(filename);
+    return n >= 4 && strcmp(filename + n - 4, ".bin") == 0;
+}
+
+static int pusta_linia(const char *s, const char *e) {
+    for (; s < e; ++s) if (*s != '\n' && *s != '\r' && *s != ' ' && *s != '\t') return 0;
+    return 1;
+}
+// Liczba calkowita z [s, e) semantyka strtol(..., 10); zwraca koniec liczby albo s.
+static const char *parsuj_int(const char *s, const char *e, int *out) {
+    const char *p = s;
+    while (p < e && bialy_znak(*p)) p++;
+    int ujemna = 0;
+    if (p < e && (*p == '+' || *p == '-')) { ujemna = (*p == '-'); p++; }
+    const char *cyfry = p;
+    long long v = 0;
+    while (p < e && (unsigned)(*p - '0') < 10) {
+        if (v < 0x7FFFFFFF) v = v * 10 + (*p - '0');
+        p++;
+    }
+    if (p == cyfry) return s;
+    if (v > 0x7FFFFFFF) v = 0x7FFFFFFF;
+    *out = (int)(ujemna ? -v : v);
+    return p;
+}
+// Naglowek z pierwszego niepustego wiersza: "wiersze<TAB>kolumny" albo "sparse<TAB>wiersze<TAB>kolumny<TAB>nnz"
+// dla macierzy rzadkiej w trojkach (*pnnz = -1 dla gestej). Kody bledow jak w loaderach.
+static int wczytaj_naglowek(Zrodlo *z, int *prows, int *pcols, long *pnnz) {
+    const char *s, *e;
+    while (nastepna_linia(z, &s, &e)) {
+        if (pusta_linia(s, e)) continue;
+        int rzadka = 0, nnz = -1;
+        while (s < e && bialy_znak(*s)) s++;
+        if (e - s >= 6 && memcmp(s, "sparse", 6) == 0) { s += 6; rzadka = 1; }
+        const char *p = parsuj_int(s, e, prows);
+        if (p == s) return 2;
+        const char *q = parsuj_int(p, e, pcols);
+        if (q == p) return 2;
+        if (*prows <= 0 || *pcols <= 0) return 3;
+        if (rzadka && (parsuj_int(q, e, &nnz) == q || nnz < 0)) return 2;
+        *pnnz = nnz;
+        return 0;
+    }
+    return 3;
+}
+// Czy plik zawiera macierz zespolona: typ z naglowka binarnego albo 'i' w tekscie. Osobny przebieg tylko dla
+// mnozenia poza pamiecia (pozostale sciezki wykrywaja typ przy wczytywaniu); dla stdin zwraca 0.
+static int plik_zespolony(const char *nazwa) {
+    if (strcmp(nazwa, "-") == 0) return 0;
+    Zrodlo z;
+    if (otworz_zrodlo(&z, nazwa) != 0) return 0;
+    int f = faza_wejdz(FAZA_TYP), wynik = 0;
+    if (zrodlo_binarne(&z)) {
+        NaglowekBin h;
+        wynik = zrodlo_czytaj(&z, &h, sizeof(h)) == sizeof(h) && h.typ == TYP_COMPLEX;
+    } else if (z.dane) {
+        // Przejrzane strony sa od razu oddawane, zeby plik nie zostawal w pamieci procesu.
+        size_t krok = (size_t)16 << 20;
+        for (size_t p = 0; p < z.rozmiar && !wynik; p += krok) {
+            size_t n = z.rozmiar - p < krok ? z.rozmiar - p : krok;
+            wynik = memchr(z.dane + p, 'i', n) != NULL;
+            madvise((char *)z.dane + p, n, MADV_DONTNEED);
+        }
+    }
+    else { const char *s, *e; while (!wynik && nastepna_linia(&z, &s, &e)) wynik = memchr(s, 'i', (size_t)(e - s)) != NULL; }
+    zamknij_zrodlo(&z);
+    faza_wyjdz(f);
+    return wynik;
+}
+
+// --- Szybkie wyjscie tekstowe ---
+// Liczby formatowane sa najkrotszym zapisem, ktory po wczytaniu daje ten sam float (jak Ryu/Grisu):
+// wartosc i granice jej przedzialu zaokraglenia (dokladne w double) skalujemy raz do 9 cyfr,
+// a potem szukamy najmniejszej liczby cyfr p, dla ktorej zaokraglenie trafia w przedzial.
+// Wynik jest na koniec weryfikowany parserem, w razie watpliwosci zostaje "%.9g".
+#define POT10_MIN (-54)
+#define POT10_MAX 48
+static double pot10_tab[POT10_MAX - POT10_MIN + 1];
+static pthread_once_t pot10_raz = PTHREAD_ONCE_INIT;
+static void pot10_inicjuj(void) {
+    for (int k = POT10_MIN; k <= POT10_MAX; ++k) pot10_tab[k - POT10_MIN] = pow(10.0, k);
+}
+static inline double pot10(int k) { return pot10_tab[k - POT10_MIN]; }
+static int zapisz_uint(char *out, unsigned long v) {
+    char tmp[24];
+    int n = 0;
+    do { tmp[n++] = (char)('0' + v % 10); v /= 10; } while (v);
+    for (int i = 0; i < n; ++i) out[i] = tmp[n - 1 - i];
+    return n;
+}
+// Zapisuje cyfry (p cyfr, pierwsza na pozycji 10^e) w notacji stalo- lub zmiennoprzecinkowej.
+static int zapisz_cyfry(char *out, const char *cyfry, int p, int e) {
+    int n = 0;
+    if (e >= -5 && e < 9) {
+        if (e < 0) {
+            out[n++] = '0'; out[n++] = '.';
+            for (int i = 0; i < -e - 1; ++i) out[n++] = '0';
+            memcpy(out + n, cyfry, (size_t)p); n += p;
+        } else {
+            for (int i = 0; i <= e; ++i) out[n++] = i < p ? cyfry[i] : '0';
+            if (p > e + 1) { out[n++] = '.'; memcpy(out + n, cyfry + e + 1, (size_t)(p - e - 1)); n += p - e - 1; }
+        }
+        return n;
+    }
+    out[n++] = cyfry[0];
+    if (p > 1) { out[n++] = '.'; memcpy(out + n, cyfry + 1, (size_t)(p - 1)); n += p - 1; }
+    out[n++] = 'e';
+    out[n++] = e < 0 ? '-' : '+';
+    if (e < 0) e = -e;
+    if (e < 10) out[n++] = '0';
+    n += zapisz_uint(out + n, (unsigned long)e);
+    return n;
+}
+// Najkrotszy zapis floata v; zwraca liczbe znakow (maks. 16, bez konczacego zera).
+static int formatuj_float(float v, char *out) {
+    int n = 0;
+    if (v != v) { memcpy(out, "nan", 3); return 3; }
+    if (signbit(v)) { out[n++] = '-'; v = -v; }
+    if (isinf(v)) { memcpy(out + n, "inf", 3); return n + 3; }
+    if (v == 0.0f) { out[n++] = '0'; return n; }
+    // Liczby calkowite ponizej 2^24 sa dokladne i najkrotsze w zapisie calkowitym.
+    if (v < 16777216.0f && v == (float)(long)v) return n + zapisz_uint(out + n, (unsigned long)v);
+    pthread_once(&pot10_raz, pot10_inicjuj);
+    double d = v;
+    int b2;
+    frexp(d, &b2);
+    int e = (int)floor((b2 - 1) * 0.30102999566398120);
+    while (pot10(e) > d) e--;
+    while (pot10(e + 1) <= d) e++;
+    double skala = pot10(8 - e);
+    double s9 = d * skala;
+    double lo = ((double)nextafterf(v, 0.0f) + d) / 2 * skala, hi = ((double)nextafterf(v, INFINITY) + d) / 2 * skala;
+    for (int p = 1; p <= 9; ++p) {
+        double u = potegi_10[9 - p];
+        double r = nearbyint(s9 / u);
+        if (p < 9 && !(r * u > lo && r * u < hi)) continue;
+        int ee = e;
+        if (r >= potegi_10[p]) { r /= 10; ee++; }
+        char cyfry[16];
+        unsigned long cyf = (unsigned long)r;
+        for (int i = p - 1; i >= 0; --i) { cyfry[i] = (char)('0' + cyf % 10); cyf /= 10; }
+        int pp = p;
+        while (pp > 1 && cyfry[pp - 1] == '0') pp--;
+        int k = zapisz_cyfry(out + n, cyfry, pp, ee);
+        float z; int erange;
+        if (parsuj_float(out + n, out + n + k, &z, &erange) == out + n + k && z == v) return n + k;
+        break;
+    }
+    char tmp[32];
+    int k = snprintf(tmp, sizeof(tmp), "%.9g", (double)v);
+    memcpy(out + n, tmp, (size_t)k);
+    return n + k;
+}
+// Reguly jak dotad: czesci mniejsze niz 1e-6 sa pomijane, "a+b*i", "a-b*i", "b*i" albo "a".
+static int formatuj_complex(const Complex *z, char *out) {
+    int has_re = (z->re > 1e-6 || z->re < -1e-6);
+    int has_im = (z->im > 1e-6 || z->im < -1e-6);
+    int n = 0;
+    if (has_re && has_im) {
+        n = formatuj_float(z->re, out);
+        if (z->im > 0) out[n++] = '+';
+        n += formatuj_float(z->im, out + n);
+        out[n++] = '*'; out[n++] = 'i';
+    } else if (has_im) {
+        n = formatuj_float(z->im, out);
+        out[n++] = '*'; out[n++] = 'i';
+    } else {
+        n = formatuj_float(z->re, out);
+    }
+    return n;
+}
+// Double (--precision f64): najkrotszy z "%.15g".."%.17g", ktory wczytuje sie z powrotem bez straty.
+static int formatuj_double(double v, char *out) {
+    int n = 0;
+    if (v != v) { memcpy(out, "nan", 3); return 3; }
+    if (signbit(v)) { out[n++] = '-'; v = -v; }
+    if (isinf(v)) { memcpy(out + n, "inf", 3); return n + 3; }
+    if (v == 0.0) { out[n++] = '0'; return n; }
+    if (v < 9007199254740992.0 && v == (double)(long)v) return n + zapisz_uint(out + n, (unsigned long)v);
+    char tmp[32];
+    int k = 0;
+    for (int p = 15; p <= 17; ++p) {
+        k = snprintf(tmp, sizeof(tmp), "%.*g", p, v);
+        if (strtod(tmp, NULL) == v) break;
+    }
+    memcpy(out + n, tmp, (size_t)k);
+    return n + k;
+}
+static int formatuj_complex_d(const ComplexD *z, char *out) {
+    int has_re = (z->re > 1e-6 || z->re < -1e-6);
+    int has_im = (z->im > 1e-6 || z->im < -1e-6);
+    int n = 0;
+    if (has_re && has_im) {
+        n = formatuj_double(z->re, out);
+        if (z->im > 0) out[n++] = '+';
+        n += formatuj_double(z->im, out + n);
+        out[n++] = '*'; out[n++] = 'i';
+    } else if (has_im) {
+        n = formatuj_double(z->im, out);
+        out[n++] = '*'; out[n++] = 'i';
+    } else {
+        n = formatuj_double(z->re, out);
+    }
+    return n;
+}
+
+// Pisarz: wiersze formatowane sa blokami rownolegle (kazdy blok we wlasnym buforze), a bloki
+// wysylane w kolejnosci duzymi wywolaniami write.
+#define WYJSCIE_BLOK (1 << 18)
+#define MAKS_ZNAKOW_FLOAT 16
+#define MAKS_ZNAKOW_DOUBLE 24
+// Gorne oszacowanie dlugosci komorki razem z separatorem.
+static size_t znaki_komorki(int typ) {
+    if (typ == TYP_COMPLEX) return 2 * MAKS_ZNAKOW_FLOAT + 4;
+    if (typ == TYP_F64) return MAKS_ZNAKOW_DOUBLE + 1;
+    if (typ == TYP_C64) return 2 * MAKS_ZNAKOW_DOUBLE + 4;
+    return MAKS_ZNAKOW_FLOAT + 1;
+}
+typedef struct { char *dane; size_t dl, cap; } BuforWyjscia;
+typedef struct {
+    int typ;
+    const void *mat;
+    const float *im;            // uklad planarny: mat to czesci rzeczywiste, im urojone (inaczej NULL)
+    int rows, cols, wiersz0, wierszy_na_blok;
+    BuforWyjscia *bufory;
+    int blad;
+} ZadanieWyjscia;
+static void formatuj_blok(void *ctx, long b) {
+    ZadanieWyjscia *z = ctx;
+    BuforWyjscia *buf = &z->bufory[b];
+    int r0 = z->wiersz0 + (int)b * z->wierszy_na_blok;
+    int r1 = r0 + z->wierszy_na_blok < z->rows ? r0 + z->wierszy_na_blok : z->rows;
+    size_t na_komorke = znaki_komorki(z->typ);
+    size_t potrzeba = (size_t)(r1 > r0 ? r1 - r0 : 0) * ((size_t)z->cols * na_komorke + 1);
+    buf->dl = 0;
+    if (potrzeba > buf->cap) {
+        char *nb = realloc(buf->dane, potrzeba);
+        if (!nb) { z->blad = 1; return; }
+        buf->dane = nb; buf->cap = potrzeba;
+    }
+    char *p = buf->dane;
+    for (int i = r0; i < r1; ++i) {
+        for (int j = 0; j < z->cols; ++j) {
+            size_t idx = (size_t)i * z->cols + j;
+            if (z->im) { Complex v = { ((const float *)z->mat)[idx], z->im[idx] }; p += formatuj_complex(&v, p); }
+            else if (z->typ == TYP_COMPLEX) p += formatuj_complex((const Complex *)z->mat + idx, p);
+            else if (z->typ == TYP_F64) p += formatuj_double(((const double *)z->mat)[idx], p);
+            else if (z->typ == TYP_C64) p += formatuj_complex_d((const ComplexD *)z->mat + idx, p);
+            else p += formatuj_float(((const float *)z->mat)[idx], p);
+            *p++ = (j + 1 < z->cols) ? '\t' : '\n';
+        }
+    }
+    buf->dl = (size_t)(p - buf->dane);
+}
+static int zapisz_wszystko(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return 1;
+        dolicz_bajty(&statystyki.zapisane, (size_t)w);
+        p += w; n -= (size_t)w;
+    }
+    return 0;
+}
+static int zapisz_tekst(int fd, int typ, const void *mat, const float *im, int rows, int cols) {
+    size_t na_wiersz = (size_t)cols * znaki_komorki(typ) + 1;
+    int wierszy = (int)(WYJSCIE_BLOK / na_wiersz);
+    if (wierszy < 1) wierszy = 1;
+    int blokow = 4 * pula.n;
+    ZadanieWyjscia z = { typ, mat, im, rows, cols, 0, wierszy, calloc((size_t)blokow, sizeof(BuforWyjscia)), 0 };
+    if (!z.bufory) return 1;
+    int f = faza_wejdz(fd == STDOUT_FILENO ? FAZA_WYPISYWANIE : FAZA_ZAPIS);
+    int wynik = 0;
+    for (int r = 0; r < rows && !wynik; r += wierszy * blokow) {
+        z.wiersz0 = r;
+        long n = (rows - r + wierszy - 1) / wierszy;
+        if (n > blokow) n = blokow;
+        rownolegle(n, formatuj_blok, &z);
+        if (z.blad) { wynik = 1; break; }
+        for (long b = 0; b < n && !wynik; ++b) wynik = zapisz_wszystko(fd, z.bufory[b].dane, z.bufory[b].dl);
+    }
+    for (int b = 0; b < blokow; ++b) free(z.bufory[b].dane);
+    free(z.bufory);
+    faza_wyjdz(f);
+    return wynik;
+}
+static int zapisz_tekstowo(int fd, int typ, const void *mat, int rows, int cols) {
+    return zapisz_tekst(fd, typ, mat, NULL, rows, cols);
+}
+static int zapisz_plik_tekst(const char *filename, int typ, const void *mat, const float *im, int rows, int cols) {
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return 1;
+    char nagl[32];
+    int n = snprintf(nagl, sizeof(nagl), "%d\t%d\n", rows, cols);
+    int wynik = zapisz_wszystko(fd, nagl, (size_t)n) || zapisz_tekst(fd, typ, mat, im, rows, cols);
+    if (close(fd) != 0) wynik = 1;
+    return wynik;
+}
+static int zapisz_plik_tekstowy(const char *filename, int typ, const void *mat, int rows, int cols) {
+    return zapisz_plik_tekst(filename, typ, mat, NULL, rows, cols);
+}
+
+// --- Wczytywanie macierzy gestych i rzadkich ---
+// Macierz rzadka w formacie CSR: elementy wiersza i to kol/wart[wiersz[i] .. wiersz[i+1]),
+// kolumny rosnaco. CSC macierzy to CSR jej transpozycji (rzadka_transpozycja).
+typedef struct {
+    int rows, cols, zespolona;
+    long nnz;
+    long *wiersz;               // rows + 1
+    int *kol;
+    void *wart;                 // nnz floatow albo Complex
+} Rzadka;
+// Wczytany argument: gesty (dane) albo rzadki (r); zespolona - dane to Complex, nie float.
+typedef struct { int rzadka, rows, cols, zespolona; void *dane; Rzadka r; } Operand;
+
+// Automatyczna konwersja do CSR tylko dla macierzy co najmniej tej wielkosci; male zostaja geste.
+#define RZADKA_MIN_ELEMENTOW (1L << 16)
+#define BLAD_INDEKSU 10
+
+static size_t rozmiar_el(int zespolona) { return zespolona ? sizeof(Complex) : sizeof(float); }
+// -0 liczy sie jako niezerowy, zeby transpozycja i zapis oddawaly go tak jak wersja gesta.
+static inline int niezerowy(float v) { return v != 0.0f || signbit(v); }
+static void rzadka_zwolnij(Rzadka *r) {
+    free(r->wiersz); free(r->kol); free(r->wart);
+    r->wiersz = NULL; r->kol = NULL; r->wart = NULL; r->nnz = 0;
+}
+static int rzadka_alokuj(Rzadka *r, int rows, int cols, long nnz, int zespolona) {
+    r->rows = rows; r->cols = cols; r->zespolona = zespolona; r->nnz = nnz;
+    r->wiersz = calloc((size_t)rows + 1, sizeof(long));
+    r->kol = malloc((size_t)(nnz > 0 ? nnz : 1) * sizeof(int));
+    r->wart = malloc((size_t)(nnz > 0 ? nnz : 1) * rozmiar_el(zespolona));
+    if (r->wiersz && r->kol && r->wart) return 0;
+    rzadka_zwolnij(r);
+    return 4;
+}
+static void zwolnij_operand(Operand *o) {
+    if (o->rzadka) rzadka_zwolnij(&o->r);
+    else zwolnij_macierz(o->dane);
+    o->dane = NULL;
+}
+// Rozszerza n floatow z poczatku bufora do Complex w miejscu (od konca, bo element Complex zajmuje
+// miejsce dwoch floatow); bufor musi miec miejsce na n elementow Complex.
+static void rozszerz_w_miejscu(void *dane, size_t n) {
+    Complex *c = dane;
+    const float *f = dane;
+    for (size_t i = n; i-- > 0;) { float v = f[i]; c[i].re = v; c[i].im = 0.0f; }
+}
+// Jak wyzej, po powiekszeniu bufora do pojemnosc elementow. NULL przy braku pamieci.
+static void *rozszerz_na_complex(void *dane, size_t n, size_t pojemnosc) {
+    Complex *c = realloc(dane, (pojemnosc ? pojemnosc : 1) * sizeof(Complex));
+    if (!c) return NULL;
+    rozszerz_w_miejscu(c, n);
+    return c;
+}
+// Kopia argumentu rzeczywistego (gestego albo CSR) rozszerzona do Complex.
+static int na_zespolony(const Operand *o, Operand *w) {
+    *w = *o;
+    w->zespolona = 1;
+    const float *src = o->rzadka ? o->r.wart : o->dane;
+    size_t n = o->rzadka ? (size_t)o->r.nnz : (size_t)o->rows * o->cols;
+    Complex *dst;
+    if (o->rzadka) {
+        if (rzadka_alokuj(&w->r, o->r.rows, o->r.cols, o->r.nnz, 1)) return 4;
+        memcpy(w->r.wiersz, o->r.wiersz, ((size_t)o->r.rows + 1) * sizeof(long));
+        memcpy(w->r.kol, o->r.kol, n * sizeof(int));
+        dst = w->r.wart;
+    } else if ((dst = w->dane = malloc(n * sizeof(Complex))) == NULL) return 4;
+    for (size_t i = 0; i < n; ++i) { dst[i].re = src[i]; dst[i].im = 0.0f; }
+    return 0;
+}
+static void rzadka_do_gestej(const Rzadka *r, void *dst) {
+    size_t el = rozmiar_el(r->zespolona);
+    memset(dst, 0, (size_t)r->rows * r->cols * el);
+    for (int i = 0; i < r->rows; ++i)
+        for (long p = r->wiersz[i]; p < r->wiersz[i + 1]; ++p)
+            memcpy((char *)dst + ((size_t)i * r->cols + r->kol[p]) * el, (const char *)r->wart + (size_t)p * el, el);
+}
+
+static int parsuj_complex(const char *s, const char *e, Complex *out);
+// Token zespolony do tabulatora; kody bledow jak w token_float.
+static const char *token_complex(const char *p, const char *e, Complex *out, int *kod) {
+    const char *start = p, *end = start;
+    while (end < e && *end != '\t' && *end != '\r') end++;
+    p = end; if (p < e && *p == '\t') p++;
+    while (start < end && bialy_znak(*start)) start++;
+    while (end > start && bialy_znak(end[-1])) end--;
+    if (start == end) *kod = 5;
+    else *kod = parsuj_complex(start, end, out) ? 0 : 6;
+    return p;
+}
+// Tokeny double (--precision f64): zawsze przez strtod, bez szybkiej sciezki float.
+static const char *token_double(const char *p, const char *e, double *out, int *kod) {
+    const char *start = p, *end = start;
+    while (end < e && *end != '\t' && *end != '\n' && *end != '\r') end++;
+    p = end; if (p < e && *p == '\t') p++;
+    while (start < end && bialy_znak(*start)) start++;
+    while (end > start && bialy_znak(end[-1])) end--;
+    if (start == end) { *kod = 5; return p; }
+    char stos[TOKEN_STOS], *t = kopiuj_token(start, end, stos), *k;
+    if (!t) { *kod = 4; return p; }
+    errno = 0;
+    *out = strtod(t, &k);
+    *kod = *k ? 6 : errno == ERANGE ? 7 : 0;
+    if (t != stos) free(t);
+    return p;
+}
+static int parsuj_complex_gen(const char *s, const char *e, int podwojna, double *re, double *im);
+static const char *token_complex_d(const char *p, const char *e, ComplexD *out, int *kod) {
+    const char *start = p, *end = start;
+    while (end < e && *end != '\t' && *end != '\r') end++;
+    p = end; if (p < e && *p == '\t') p++;
+    while (start < end && bialy_znak(*start)) start++;
+    while (end > start && bialy_znak(end[-1])) end--;
+    if (start == end) *kod = 5;
+    else *kod = parsuj_complex_gen(start, end, 1, &out->re, &out->im) ? 0 : 6;
+    return p;
+}
+static int parsuj_wiersz(const char *p, const char *e, int typ, int cols, void *wiersz) {
+    int kod = 0;
+    for (int c = 0; c < cols && !kod; ++c) {
+        if (typ == TYP_COMPLEX) p = token_complex(p, e, (Complex *)wiersz + c, &kod);
+        else if (typ == TYP_F64) p = token_double(p, e, (double *)wiersz + c, &kod);
+        else if (typ == TYP_C64) p = token_complex_d(p, e, (ComplexD *)wiersz + c, &kod);
+        else p = token_float(p, e, (float *)wiersz + c, &kod);
+    }
+    return kod;
+}
+
+// Plik rzadki: trojki "i j v" (numeracja od 1) w dowolnej kolejnosci. Sortowanie przez zliczanie
+// najpierw po kolumnach, potem stabilnie po wierszach; powtorzone pozycje sa sumowane.
+// TYP_AUTO: wartosci float do pierwszej zespolonej, wtedy wczytane juz trojki przechodza na Complex.
+static int wczytaj_trojki(Zrodlo *z, int rows, int cols, long nnz, int typ, Rzadka *r) {
+    int zesp = typ == TYP_COMPLEX;
+    size_t el = rozmiar_el(zesp);
+    int *ti = malloc((size_t)(nnz > 0 ? nnz : 1) * sizeof(int)), *tj = malloc((size_t)(nnz > 0 ? nnz : 1) * sizeof(int));
+    char *tv = malloc((size_t)(nnz > 0 ? nnz : 1) * el);
+    long *pocz = calloc((size_t)cols + 1, sizeof(long)), *perm = malloc((size_t)(nnz > 0 ? nnz : 1) * sizeof(long));
+    long *poz = malloc(((size_t)rows + 1) * sizeof(long));
+    int kod = (ti && tj && tv && pocz && perm && poz) ? 0 : 4;
+    long k = 0;
+    const char *s, *e;
+    while (!kod && k < nnz && nastepna_linia(z, &s, &e)) {
+        if (pusta_linia(s, e)) continue;
+        int i, j;
+        const char *p = parsuj_int(s, e, &i), *q = p == s ? p : parsuj_int(p, e, &j);
+        if (p == s || q == p) { kod = 2; break; }
+        if (i < 1 || i > rows || j < 1 || j > cols) { kod = BLAD_INDEKSU; break; }
+        while (q < e && bialy_znak(*q)) q++;
+        if (!zesp) token_float(q, e, (float *)tv + k, &kod);
+        if (kod == 6 && typ == TYP_AUTO && memchr(q, 'i', (size_t)(e - q))) {
+            char *nowe = rozszerz_na_complex(tv, (size_t)k, (size_t)nnz);
+            if (!nowe) { kod = 4; break; }
+            tv = nowe; zesp = 1; el = sizeof(Complex); kod = 0;
+        }
+        if (zesp) token_complex(q, e, (Complex *)tv + k, &kod);
+        ti[k] = i - 1; tj[k] = j - 1; k++;
+    }
+    if (!kod && k < nnz) kod = 8;
+    if (!kod) kod = rzadka_alokuj(r, rows, cols, nnz, zesp);
+    if (!kod) {
+        for (long t = 0; t < nnz; ++t) pocz[tj[t] + 1]++;
+        for (int j = 0; j < cols; ++j) pocz[j + 1] += pocz[j];
+        for (long t = 0; t < nnz; ++t) perm[pocz[tj[t]]++] = t;
+        for (long t = 0; t < nnz; ++t) r->wiersz[ti[t] + 1]++;
+        for (int i = 0; i < rows; ++i) r->wiersz[i + 1] += r->wiersz[i];
+        memcpy(poz, r->wiersz, ((size_t)rows + 1) * sizeof(long));
+        for (long t = 0; t < nnz; ++t) {
+            long src = perm[t], d = poz[ti[src]]++;
+            r->kol[d] = tj[src];
+            memcpy((char *)r->wart + (size_t)d * el, tv + (size_t)src * el, el);
+        }
+        // Scalenie powtorzen w miejscu
+        long w = 0;
+        for (int i = 0; i < rows; ++i) {
+            long p0 = r->wiersz[i], p1 = r->wiersz[i + 1];
+            r->wiersz[i] = w;
+            for (long p = p0; p < p1; ++p) {
+                if (w > r->wiersz[i] && r->kol[w - 1] == r->kol[p]) {
+                    if (zesp) { ((Complex *)r->wart)[w - 1].re += ((Complex *)r->wart)[p].re; ((Complex *)r->wart)[w - 1].im += ((Complex *)r->wart)[p].im; }
+                    else ((float *)r->wart)[w - 1] += ((float *)r->wart)[p];
+                    continue;
+                }
+                r->kol[w] = r->kol[p];
+                memcpy((char *)r->wart + (size_t)w * el, (char *)r->wart + (size_t)p * el, el);
+                w++;
+            }
+        }
+        r->wiersz[rows] = w;
+        r->nnz = w;
+    }
+    free(ti); free(tj); free(tv); free(pocz); free(perm); free(poz);
+    return kod;
+}
+
+// Tekst gesty. Przy prog > 0 niezerowe elementy ida od razu do CSR (przez bufor jednego wiersza),
+// a gesta macierz powstaje dopiero, gdy liczba niezerowych przekroczy prog * rows * cols.
+// TYP_AUTO: jak w wczytaj_trojki, pierwszy wiersz z liczba zespolona rozszerza dotychczasowe dane.
+static int wczytaj_tekst_gesty(Zrodlo *z, int rows, int cols, int typ, double prog, Operand *o) {
+    int zesp = typ == TYP_COMPLEX;
+    size_t el = rozmiar_el(zesp), wiersz_b = (size_t)cols * el;
+    long limit = prog > 0 && (long)rows * cols >= RZADKA_MIN_ELEMENTOW ? (long)(prog * rows * cols) : -1;
+    char *gesta = NULL, *bufor = NULL;
+    Rzadka *r = &o->r;
+    long pojemnosc = 0;
+    memset(r, 0, sizeof(*r));
+    r->rows = rows; r->cols = cols; r->zespolona = zesp;
+    if (limit < 0) gesta = malloc((size_t)rows * wiersz_b);
+    else { bufor = malloc(wiersz_b); r->wiersz = calloc((size_t)rows + 1, sizeof(long)); }
+    int kod = (gesta || (bufor && r->wiersz)) ? 0 : 4;
+    int w = 0;
+    const char *p, *e;
+    while (!kod && w < rows && nastepna_linia(z, &p, &e)) {
+        if (pusta_linia(p, e)) continue;
+        char *cel = gesta ? gesta + (size_t)w * wiersz_b : bufor;
+        kod = parsuj_wiersz(p, e, zesp ? TYP_COMPLEX : TYP_FLOAT, cols, cel);
+        if (kod == 6 && typ == TYP_AUTO && !zesp && memchr(p, 'i', (size_t)(e - p))) {
+            if (gesta) {
+                char *g = rozszerz_na_complex(gesta, (size_t)w * cols, (size_t)rows * cols);
+                if (!g) { kod = 4; break; }
+                gesta = g;
+            } else {
+                char *b = realloc(bufor, (size_t)cols * sizeof(Complex));
+                if (b) bufor = b;
+                void *nw = b ? rozszerz_na_complex(r->wart, (size_t)r->nnz, (size_t)pojemnosc) : NULL;
+                if (!nw) { kod = 4; break; }
+                r->wart = nw; r->zespolona = 1;
+            }
+            zesp = 1; el = sizeof(Complex); wiersz_b = (size_t)cols * el;
+            cel = gesta ? gesta + (size_t)w * wiersz_b : bufor;
+            kod = parsuj_wiersz(p, e, TYP_COMPLEX, cols, cel);
+        }
+        if (kod) break;
+        if (!gesta) {
+            long niezerowe = 0;
+            for (int c = 0; c < cols; ++c)
+                niezerowe += zesp ? (niezerowy(((Complex *)bufor)[c].re) || niezerowy(((Complex *)bufor)[c].im)) : niezerowy(((float *)bufor)[c]);
+            if (r->nnz + niezerowe > limit) {
+                // Za gesta na CSR: rozwiniecie tego, co juz wczytane, i dalej wprost do gestej.
+                r->rows = w;
+                gesta = malloc((size_t)rows * wiersz_b);
+                if (!gesta) { kod = 4; break; }
+                rzadka_do_gestej(r, gesta);
+                memcpy(gesta + (size_t)w * wiersz_b, bufor, wiersz_b);
+                rzadka_zwolnij(r);
+            } else {
+                if (r->nnz + niezerowe > pojemnosc) {
+                    long nowa = pojemnosc ? pojemnosc * 2 : 4096;
+                    while (nowa < r->nnz + niezerowe) nowa *= 2;
+                    if (nowa > limit) nowa = limit;
+                    int *nk = realloc(r->kol, (size_t)nowa * sizeof(int));
+                    if (nk) r->kol = nk;
+                    void *nw = nk ? realloc(r->wart, (size_t)nowa * el) : NULL;
+                    if (!nw) { kod = 4; break; }
+                    r->wart = nw; pojemnosc = nowa;
+                }
+                for (int c = 0; c < cols; ++c) {
+                    if (zesp ? !niezerowy(((Complex *)bufor)[c].re) && !niezerowy(((Complex *)bufor)[c].im) : !niezerowy(((float *)bufor)[c])) continue;
+                    r->kol[r->nnz] = c;
+                    memcpy((char *)r->wart + (size_t)r->nnz * el, bufor + (size_t)c * el, el);
+                    r->nnz++;
+                }
+                r->wiersz[w + 1] = r->nnz;
+            }
+        }
+        w++;
+    }
+    free(bufor);
+    if (!kod && w < rows) kod = 8;
+    if (kod) { free(gesta); rzadka_zwolnij(r); return kod; }
+    o->rows = rows; o->cols = cols; o->zespolona = zesp;
+    if (gesta) { o->dane = gesta; o->rzadka = 0; }
+    else o->rzadka = 1;
+    return 0;
+}
+
+// Wczytuje plik binarny, tekstowy gesty albo rzadki ("sparse ..."). prog <= 0: wynik zawsze gesty;
+// prog > 0: plik rzadki zostaje w CSR, a gesty tekst o gestosci ponizej prog jest konwertowany.
+// Typ TYP_AUTO wykrywany jest w tym samym przebiegu (o->zespolona), bez osobnego czytania pliku.
+static int wczytaj_operand(const char *nazwa_pliku, int typ, double prog, Operand *o) {
+    memset(o, 0, sizeof(*o));
+    Zrodlo z;
+    if (otworz_zrodlo(&z, nazwa_pliku) != 0) { fprintf(stderr, "Nie mozna otworzyc pliku %s\n", nazwa_pliku); return 1; }
+    int f = faza_wejdz(FAZA_WCZYTYWANIE), kod;
+    if (zrodlo_binarne(&z)) {
+        kod = wczytaj_binarnie(&z, &typ, &o->dane, &o->rows, &o->cols);
+        o->zespolona = typ == TYP_COMPLEX;
+    } else {
+        long nnz;
+        kod = wczytaj_naglowek(&z, &o->rows, &o->cols, &nnz);
+        if (!kod && nnz >= 0) {
+            kod = wczytaj_trojki(&z, o->rows, o->cols, nnz, typ, &o->r);
+            o->rzadka = !kod;
+            o->zespolona = o->r.zespolona;
+            if (!kod && prog <= 0) {
+                o->dane = malloc((size_t)o->rows * o->cols * rozmiar_el(o->zespolona));
+                if (o->dane) rzadka_do_gestej(&o->r, o->dane);
+                else kod = 4;
+                rzadka_zwolnij(&o->r);
+                o->rzadka = 0;
+            }
+        } else if (!kod) kod = wczytaj_tekst_gesty(&z, o->rows, o->cols, typ, prog, o);
+    }
+    zamknij_zrodlo(&z);
+    faza_wyjdz(f);
+    return kod;
+}
+
+// --- Funkcje dla macierzy rzeczywistych ---
+int wczytaj_macierz(const char *nazwa_pliku, float **pmat, int *prows, int *pcols) {
+    Operand o;
+    int kod = wczytaj_operand(nazwa_pliku, TYP_FLOAT, 0.0, &o);
+    if (kod == 0) { *pmat = o.dane; *prows = o.rows; *pcols = o.cols; }
+    return kod;
+}
+void wypisz_macierz(const float *mat, int rows, int cols) {
+    fflush(stdout);
+    zapisz_tekstowo(STDOUT_FILENO, TYP_FLOAT, mat, rows, cols);
+}
+int dodaj_macierze(const float *a, const float *b, float *wynik, int rows, int cols) {
+    dolicz_flop((double)rows * cols);
+    ew_rownolegle(jadra.dodaj, a, b, wynik, (size_t)rows * cols);
+    return 0;
+}
+int odejmij_macierze(const float *a, const float *b, float *wynik, int rows, int cols) {
+    dolicz_flop((double)rows * cols);
+    ew_rownolegle(jadra.odejmij, a, b, wynik, (size_t)rows * cols);
+    return 0;
+}
+// --- Silnik mnozenia blokowego (GEMM) ---
+// Klasyczny podzial Goto/BLIS: panel B (KC x NC) siedzi w L3, blok A (MC x KC) w L2,
+// a mikrojadro liczy kafelek MR x NR w rejestrach, czytajac spakowane panele ciagle.
+#define GEMM_MC 144
+#define GEMM_KC 256
+#define GEMM_NC 4096
+#define GEMM_ALIGN 64
+
+static void *alokuj_wyrownane(size_t n) {
+    void *p = NULL;
+    if (posix_memalign(&p, GEMM_ALIGN, n ? n : GEMM_ALIGN) != 0) return NULL;
+    return p;
+}
+// Pakuje blok A (mc x kc) w panele po MR wierszy; brakujace wiersze uzupelnia zerami.
+static void pakuj_a(int mc, int kc, const float *a, long rsa, long csa, float *buf) {
+    for (int i = 0; i < mc; i += GEMM_MR) {
+        int mr = mc - i < GEMM_MR ? mc - i : GEMM_MR;
+        for (int k = 0; k < kc; ++k) {
+            const float *src = a + (long)i * rsa + (long)k * csa;
+            int r = 0;
+            for (; r < mr; ++r) buf[r] = src[(long)r * rsa];
+            for (; r < GEMM_MR; ++r) buf[r] = 0.0f;
+            buf += GEMM_MR;
+        }
+    }
+}
+// Pakuje panel B (kc x nc) w paski po NR kolumn; brakujace kolumny uzupelnia zerami.
+static void pakuj_b(int kc, int nc, const float *b, long rsb, long csb, float *buf) {
+    for (int j = 0; j < nc; j += GEMM_NR) {
+        int nr = nc - j < GEMM_NR ? nc - j : GEMM_NR;
+        for (int k = 0; k < kc; ++k) {
+            const float *src = b + (long)k * rsb + (long)j * csb;
+            int c = 0;
+            if (csb == 1) { memcpy(buf, src, (size_t)nr * sizeof(float)); c = nr; }
+            else for (; c < nr; ++c) buf[c] = src[(long)c * csb];
+            for (; c < GEMM_NR; ++c) buf[c] = 0.0f;
+            buf += GEMM_NR;
+        }
+    }
+}
+// Bufory pakowania sa per watek i rosna wedlug potrzeb - zadania nie alokuja pamieci w kolko.
+// bufor_c: kafelek C w double dla --precision mixed.
+static __thread float *bufor_a = NULL, *bufor_b = NULL, *bufor_c = NULL;
+static __thread size_t bufor_a_n = 0, bufor_b_n = 0, bufor_c_n = 0;
+static float *bufor_watku(float **buf, size_t *pojemnosc, size_t n) {
+    if (n > *pojemnosc) {
+        free(*buf);
+        *buf = alokuj_wyrownane(n * sizeof(float));
+        *pojemnosc = *buf ? n : 0;
+    }
+    return *buf;
+}
+
+typedef struct {
+    int m, n, k;
+    float alpha;
+    const float *a, *b;
+    long rsa, csa, rsb, csb;
+    int akumuluj;
+    float *c;
+    long ldc;
+    int mt, nt, kafle_n;        // rozmiar kafelka C na zadanie i liczba kafelkow w poziomie
+    int blad;
+    int szer_c;                 // szerokosc calego C (n albo wiecej, gdy C liczone jest pasami kolumn)
+} ZadanieGemm;
+
+// Jedno zadanie liczy kafelek C (mt x nt) przez cale K. Kolejnosc sumowania po k nie zalezy
+// od wymiarow kafelka, wiec wynik jest ten sam przy dowolnej liczbie watkow. Dlatego galaz
+// skalarna wybiera szerokosc calego C, a nie kafelka: waski ostatni kafelek (zalezny od liczby
+// watkow albo od podzialu --mem-limit) idzie przez mikrojadro z czesciowym nr jak pozostale kolumny.
+static void gemm_kafelek(void *ctx, long t) {
+    ZadanieGemm *z = ctx;
+    int i0 = (int)(t / z->kafle_n) * z->mt, j0 = (int)(t % z->kafle_n) * z->nt;
+    int m = z->m - i0 < z->mt ? z->m - i0 : z->mt;
+    int n = z->n - j0 < z->nt ? z->n - j0 : z->nt;
+    const float *a = z->a + (long)i0 * z->rsa;
+    const float *b = z->b + (long)j0 * z->csb;
+    float *c = z->c + (long)i0 * z->ldc + j0;
+    if (z->szer_c < 4) {
+        // Iloczyn macierz-wektor: paski NR bylyby prawie puste, wystarczy iloczyn skalarny.
+        for (int i = 0; i < m; ++i)
+            for (int j = 0; j < n; ++j) {
+                const float *ar = a + (long)i * z->rsa, *bc = b + (long)j * z->csb;
+                float sum = 0.0f;
+                for (int p = 0; p < z->k; ++p) sum += ar[(long)p * z->csa] * bc[(long)p * z->rsb];
+                float *cv = c + (long)i * z->ldc + j;
+                *cv = z->akumuluj ? *cv + z->alpha * sum : z->alpha * sum;
+            }
+        return;
+    }
+    // Bufory przyciete do faktycznego rozmiaru - male iloczyny nie placa za pelne panele.
+    size_t kmax = (size_t)(z->k < GEMM_KC ? z->k : GEMM_KC);
+    size_t mmax = (size_t)(m < GEMM_MC ? (m + GEMM_MR - 1) / GEMM_MR * GEMM_MR : GEMM_MC);
+    size_t nmax = (size_t)(n < GEMM_NC ? (n + GEMM_NR - 1) / GEMM_NR * GEMM_NR : GEMM_NC);
+    float *abuf = bufor_watku(&bufor_a, &bufor_a_n, mmax * kmax);
+    float *bbuf = bufor_watku(&bufor_b, &bufor_b_n, kmax * nmax);
+    if (!abuf || !bbuf) { z->blad = 1; return; }
+    for (int jc = 0; jc < n; jc += GEMM_NC) {
+        int nc = n - jc < GEMM_NC ? n - jc : GEMM_NC;
+        for (int pc = 0; pc < z->k; pc += GEMM_KC) {
+            int kc = z->k - pc < GEMM_KC ? z->k - pc : GEMM_KC;
+            int acc = z->akumuluj || pc > 0;
+            pakuj_b(kc, nc, b + (long)pc * z->rsb + (long)jc * z->csb, z->rsb, z->csb, bbuf);
+            for (int ic = 0; ic < m; ic += GEMM_MC) {
+                int mc = m - ic < GEMM_MC ? m - ic : GEMM_MC;
+                pakuj_a(mc, kc, a + (long)ic * z->rsa + (long)pc * z->csa, z->rsa, z->csa, abuf);
+                for (int jr = 0; jr < nc; jr += GEMM_NR) {
+                    int nr = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+                    for (int ir = 0; ir < mc; ir += GEMM_MR) {
+                        int mr = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+                        jadra.mikro(kc, abuf + (long)ir * kc, bbuf + (long)jr * kc,
+                                    c + (long)(ic + ir) * z->ldc + jc + jr, z->ldc,
+                                    z->alpha, acc, mr, nr);
+                    }
+                }
+            }
+        }
+    }
+}
+// --precision: f32 - dane i obliczenia we float; mixed - dane float, iloczyny (gemm_f32, gemm_c32)
+// sumowane w double i zaokraglane raz; f64 - dane i obliczenia w double (osobna sciezka w main).
+enum { PRECYZJA_F32, PRECYZJA_MIESZANA, PRECYZJA_F64 };
+static int precyzja = PRECYZJA_F32;
+
+// GEMM w double dla argumentow float albo double (a_f32, b_f32, c_f32): panele pakowane sa do double,
+// wiec jedno mikrojadro obsluguje oba typy danych. Przy C we float kafelek C sumowany jest w buforze
+// double przez cale K i zaokraglany raz na koniec; C w double akumuluje sie wprost.
+#define GEMM_NC_D 512
+typedef struct {
+    int m, n, k;
+    double alpha;
+    const void *a, *b;
+    long rsa, csa, rsb, csb;
+    int akumuluj, a_f32, b_f32, c_f32;
+    void *c;
+    long ldc;
+    int mt, nt, kafle_n;
+    int blad;
+} ZadanieGemmD;
+static inline double el_d(const void *p, long i, int f32) { return f32 ? (double)((const float *)p)[i] : ((const double *)p)[i]; }
+// Jak pakuj_a/pakuj_b, ale do double; o - indeks poczatku bloku w zrodle.
+static void pakuj_a_d(int mc, int kc, const void *a, int f32, long o, long rsa, long csa, double *buf) {
+    for (int i = 0; i < mc; i += GEMM_MR_D) {
+        int mr = mc - i < GEMM_MR_D ? mc - i : GEMM_MR_D;
+        for (int k = 0; k < kc; ++k) {
+            long src = o + (long)i * rsa + (long)k * csa;
+            int r = 0;
+            for (; r < mr; ++r) buf[r] = el_d(a, src + (long)r * rsa, f32);
+            for (; r < GEMM_MR_D; ++r) buf[r] = 0.0;
+            buf += GEMM_MR_D;
+        }
+    }
+}
+static void pakuj_b_d(int kc, int nc, const void *b, int f32, long o, long rsb, long csb, double *buf) {
+    for (int j = 0; j < nc; j += GEMM_NR_D) {
+        int nr = nc - j < GEMM_NR_D ? nc - j : GEMM_NR_D;
+        for (int k = 0; k < kc; ++k) {
+            long src = o + (long)k * rsb + (long)j * csb;
+            int c = 0;
+            for (; c < nr; ++c) buf[c] = el_d(b, src + (long)c * csb, f32);
+            for (; c < GEMM_NR_D; ++c) buf[c] = 0.0;
+            buf += GEMM_NR_D;
+        }
+    }
+}
+static void gemm_d_kafelek(void *ctx, long t) {
+    ZadanieGemmD *z = ctx;
+    int i0 = (int)(t / z->kafle_n) * z->mt, j0 = (int)(t % z->kafle_n) * z->nt;
+    int m = z->m - i0 < z->mt ? z->m - i0 : z->mt;
+    int n = z->n - j0 < z->nt ? z->n - j0 : z->nt;
+    long oa = (long)i0 * z->rsa, ob = (long)j0 * z->csb, oc = (long)i0 * z->ldc + j0;
+    float *cf = z->c_f32 ? (float *)z->c + oc : NULL;
+    double *cd = z->c_f32 ? NULL : (double *)z->c + oc;
+    if (z->n < 4) {                 // jak w gemm_kafelek: szerokosc calego C, nie kafelka
+        for (int i = 0; i < m; ++i)
+            for (int j = 0; j < n; ++j) {
+                double sum = 0.0;
+                for (int p = 0; p < z->k; ++p)
+                    sum += el_d(z->a, oa + (long)i * z->rsa + (long)p * z->csa, z->a_f32) * el_d(z->b, ob + (long)j * z->csb + (long)p * z->rsb, z->b_f32);
+                long ic = (long)i * z->ldc + j;
+                if (cf) cf[ic] = (float)(z->akumuluj ? cf[ic] + z->alpha * sum : z->alpha * sum);
+                else cd[ic] = z->akumuluj ? cd[ic] + z->alpha * sum : z->alpha * sum;
+            }
+        return;
+    }
+    size_t kmax = (size_t)(z->k < GEMM_KC ? z->k : GEMM_KC);
+    size_t mmax = (size_t)(m < GEMM_MC ? (m + GEMM_MR_D - 1) / GEMM_MR_D * GEMM_MR_D : GEMM_MC);
+    size_t nmax = (size_t)(n < GEMM_NC ? (n + GEMM_NR_D - 1) / GEMM_NR_D * GEMM_NR_D : GEMM_NC);
+    double *abuf = (double *)bufor_watku(&bufor_a, &bufor_a_n, 2 * mmax * kmax);
+    double *bbuf = (double *)bufor_watku(&bufor_b, &bufor_b_n, 2 * kmax * nmax);
+    // C we float: sumy w kafelku double (m x n), alpha i akumulacja dopiero przy zaokragleniu.
+    double *kafel = cf ? (double *)bufor_watku(&bufor_c, &bufor_c_n, 2 * (size_t)m * n) : cd;
+    long ldk = cf ? n : z->ldc;
+    if (!abuf || !bbuf || !kafel) { z->blad = 1; return; }
+    for (int jc = 0; jc < n; jc += GEMM_NC) {
+        int nc = n - jc < GEMM_NC ? n - jc : GEMM_NC;
+        for (int pc = 0; pc < z->k; pc += GEMM_KC) {
+            int kc = z->k - pc < GEMM_KC ? z->k - pc : GEMM_KC;
+            int acc = cf ? pc > 0 : z->akumuluj || pc > 0;
+            pakuj_b_d(kc, nc, z->b, z->b_f32, ob + (long)pc * z->rsb + (long)jc * z->csb, z->rsb, z->csb, bbuf);
+            for (int ic = 0; ic < m; ic += GEMM_MC) {
+                int mc = m - ic < GEMM_MC ? m - ic : GEMM_MC;
+                pakuj_a_d(mc, kc, z->a, z->a_f32, oa + (long)ic * z->rsa + (long)pc * z->csa, z->rsa, z->csa, abuf);
+                for (int jr = 0; jr < nc; jr += GEMM_NR_D) {
+                    int nr = nc - jr < GEMM_NR_D ? nc - jr : GEMM_NR_D;
+                    for (int ir = 0; ir < mc; ir += GEMM_MR_D) {
+                        int mr = mc - ir < GEMM_MR_D ? mc - ir : GEMM_MR_D;
+                        jadra.mikro_d(kc, abuf + (long)ir * kc, bbuf + (long)jr * kc,
+                                      kafel + (long)(ic + ir) * ldk + jc + jr, ldk,
+                                      cf ? 1.0 : z->alpha, acc, mr, nr);
+                    }
+                }
+            }
+        }
+    }
+    if (cf)
+        for (int i = 0; i < m; ++i) {
+            float *crow = cf + (long)i * z->ldc;
+            const double *krow = kafel + (long)i * n;
+            if (z->akumuluj) for (int j = 0; j < n; ++j) crow[j] = (float)(crow[j] + z->alpha * krow[j]);
+            else for (int j = 0; j < n; ++j) crow[j] = (float)(z->alpha * krow[j]);
+        }
+}
+static int gemm_d(int m, int n, int k, double alpha,
+                  const void *a, int a_f32, long rsa, long csa, const void *b, int b_f32, long rsb, long csb,
+                  int akumuluj, void *c, int c_f32, long ldc) {
+    if (m <= 0 || n <= 0) return 0;
+    if (k <= 0) {
+        if (!akumuluj) for (int i = 0; i < m; ++i) memset((char *)c + (size_t)i * ldc * (c_f32 ? 4 : 8), 0, (size_t)n * (c_f32 ? 4 : 8));
+        return 0;
+    }
+    ZadanieGemmD z = { m, n, k, alpha, a, b, rsa, csa, rsb, csb, akumuluj, a_f32, b_f32, c_f32, c, ldc,
+                       GEMM_MC, c_f32 ? GEMM_NC_D : GEMM_NC, 0, 0 };
+    if (n < 4) z.mt = 256;
+    long cel = 4L * pula.n;
+    while (pula.n > 1 && (long)((m + z.mt - 1) / z.mt) * ((n + z.nt - 1) / z.nt) < cel) {
+        if (z.nt > 4 * GEMM_NR && z.nt >= z.mt) z.nt /= 2;
+        else if (z.mt > 4 * GEMM_MR_D) z.mt /= 2;
+        else break;
+    }
+    z.kafle_n = (n + z.nt - 1) / z.nt;
+    rownolegle((long)((m + z.mt - 1) / z.mt) * z.kafle_n, gemm_d_kafelek, &z);
+    return z.blad;
+}
+
+// C[M x N] = alpha * A[M x K] * B[K x N] (+ C gdy akumuluj). Kroki wierszy/kolumn pozwalaja
+// podac A lub B jako widok transponowany bez kopiowania. C dzielone jest na kafelki wyjsciowe,
+// ktore pula watkow rozdziela miedzy rdzenie. gemm_f32_pas liczy pas kolumn wiekszego C
+// o szerokosci szer_c, dajac te same bity co jedno wywolanie na calym C.
+static int gemm_f32_pas(int m, int n, int k, float alpha,
+                        const float *a, long rsa, long csa, const float *b, long rsb, long csb,
+                        int akumuluj, float *c, long ldc, int szer_c) {
+    if (precyzja == PRECYZJA_MIESZANA) return gemm_d(m, n, k, alpha, a, 1, rsa, csa, b, 1, rsb, csb, akumuluj, c, 1, ldc);
+    if (m <= 0 || n <= 0) return 0;
+    if (k <= 0) {
+        if (!akumuluj) for (int i = 0; i < m; ++i) memset(c + (long)i * ldc, 0, (size_t)n * sizeof(float));
+        return 0;
+    }
+    ZadanieGemm z = { m, n, k, alpha, a, b, rsa, csa, rsb, csb, akumuluj, c, ldc, GEMM_MC, GEMM_NC, 0, 0, szer_c };
+    if (szer_c < 4) z.mt = 256;
+    // Drobniejsze kafelki, dopoki kazdy watek nie ma kilku zadan do podkradania.
+    long cel = 4L * pula.n;
+    while (pula.n > 1 && (long)((m + z.mt - 1) / z.mt) * ((n + z.nt - 1) / z.nt) < cel) {
+        if (z.nt > 4 * GEMM_NR && z.nt >= z.mt) z.nt /= 2;
+        else if (z.mt > 4 * GEMM_MR) z.mt /= 2;
+        else break;
+    }
+    z.kafle_n = (n + z.nt - 1) / z.nt;
+    rownolegle((long)((m + z.mt - 1) / z.mt) * z.kafle_n, gemm_kafelek, &z);
+    return z.blad;
+}
+static int gemm_f32(int m, int n, int k, float alpha,
+                    const float *a, long rsa, long csa, const float *b, long rsb, long csb,
+                    int akumuluj, float *c, long ldc) {
+    return gemm_f32_pas(m, n, k, alpha, a, rsa, csa, b, rsb, csb, akumuluj, c, ldc, n);
+}
+// Szybkie mnozenie (--strassen N, --3m). Prog 0 - zawsze klasyczny GEMM.
+static int prog_strassena = 0, mnozenie_3m = 0;
+// Iloczyn zespolony na plaszczyznach re/im (--complex-layout planar, domyslnie) albo kafelkami Complex.
+static int uklad_planarny = 1;
+static int strassen(int m, int n, int k, const void *a, const void *b, void *c, int zespolona, int prog);
+int mnoz_macierze(const float *a, int a_rows, int a_cols, const float *b, int b_rows, int b_cols, float *wynik) {
+    if (a_cols != b_rows) return 1;
+    dolicz_flop(2.0 * a_rows * a_cols * b_cols);
+    if (prog_strassena > 0) return strassen(a_rows, b_cols, a_cols, a, b, wynik, 0, prog_strassena) ? 4 : 0;
+    return gemm_f32(a_rows, b_cols, a_cols, 1.0f, a, a_cols, 1, b, b_cols, 1, 0, wynik, b_cols) ? 4 : 0;
+}
+// Wersja referencyjna (petla i-j-k) do weryfikacji wynikow silnika blokowego.
+int mnoz_macierze_ref(const float *a, int a_rows, int a_cols, const float *b, int b_rows, int b_cols, float *wynik) {
+    if (a_cols != b_rows) return 1;
+    for (int i = 0; i < a_rows; ++i) {
+        for (int j = 0; j < b_cols; ++j) {
+            float sum = 0.0f;
+            for (int k = 0; k < a_cols; ++k) {
+                sum += a[i * a_cols + k] * b[k * b_cols + j];
+            }
+            wynik[i * b_cols + j] = sum;
+        }
+    }
+    return 0;
+}
+// Transpozycja bloku m x n (src, krok lds) do dst (krok ldd) kafelkami rejestrowymi jadra; brzegi skalarnie.
+static void transponuj_blok(const void *src, long lds, void *dst, long ldd, int m, int n, int zespolona) {
+    jadro_transp_t f = zespolona ? jadra.transp_c : jadra.transp_f;
+    int b = zespolona ? jadra.tr_c : jadra.tr_f;
+    long el = zespolona ? (long)sizeof(Complex) : (long)sizeof(float);
+    int mb = m - m % b, nb = n - n % b;
+    for (int i = 0; i < mb; i += b)
+        for (int j = 0; j < nb; j += b)
+            f((const char *)src + ((long)i * lds + j) * el, lds, (char *)dst + ((long)j * ldd + i) * el, ldd);
+    for (int i = 0; i < m; ++i)
+        for (int j = i < mb ? nb : 0; j < n; ++j) {
+            if (zespolona) ((Complex *)dst)[(long)j * ldd + i] = ((const Complex *)src)[(long)i * lds + j];
+            else ((float *)dst)[(long)j * ldd + i] = ((const float *)src)[(long)i * lds + j];
+        }
+}
+// Transpozycja dzielona na pasy wierszy zrodla; kazdy pas zapisuje rozlaczny zestaw kolumn dst.
+// Wewnatrz pasa bloki TRANSPOZYCJA_PAS x TRANSPOZYCJA_PAS, zeby zrodlo i cel miescily sie w L1/L2.
+#define TRANSPOZYCJA_PAS 64
+typedef struct { const void *src; void *dst; int rows, cols, zespolona; } ZadanieTranspozycji;
+static void transpozycja_pas(void *ctx, long t) {
+    ZadanieTranspozycji *z = ctx;
+    long el = z->zespolona ? (long)sizeof(Complex) : (long)sizeof(float);
+    int i0 = (int)t * TRANSPOZYCJA_PAS, m = z->rows - i0 < TRANSPOZYCJA_PAS ? z->rows - i0 : TRANSPOZYCJA_PAS;
+    for (int j0 = 0; j0 < z->cols; j0 += TRANSPOZYCJA_PAS) {
+        int n = z->cols - j0 < TRANSPOZYCJA_PAS ? z->cols - j0 : TRANSPOZYCJA_PAS;
+        transponuj_blok((const char *)z->src + ((long)i0 * z->cols + j0) * el, z->cols,
+                        (char *)z->dst + ((long)j0 * z->rows + i0) * el, z->rows, m, n, z->zespolona);
+    }
+}
+static void transpozycja(const void *src, void *dst, int rows, int cols, int zespolona) {
+    ZadanieTranspozycji z = { src, dst, rows, cols, zespolona };
+    rownolegle((rows + TRANSPOZYCJA_PAS - 1) / TRANSPOZYCJA_PAS, transpozycja_pas, &z);
+}
+void transpose_float(const float *src, float *dst, int rows, int cols) {
+    transpozycja(src, dst, rows, cols, 0);
+}
+
+// --- Transpozycja w miejscu ---
+// Kwadrat: zamiana par blokow (I,J) <-> (J,I) przez bufor jednego bloku. Zadanie puli bierze
+// wiersz blokow t i wiersz z drugiego konca, zeby zadania byly podobnej wielkosci.
+typedef struct { char *mat; int n, kafle, zespolona; } ZadanieZamiany;
+static void zamiana_blokow(void *ctx, long t) {
+    ZadanieZamiany *z = ctx;
+    long el = z->zespolona ? (long)sizeof(Complex) : (long)sizeof(float);
+    Complex bufor[TRANSPOZYCJA_PAS * TRANSPOZYCJA_PAS];
+    int wiersze[2] = { (int)t, z->kafle - 1 - (int)t };
+    for (int w = 0; w < (wiersze[0] == wiersze[1] ? 1 : 2); ++w) {
+        int i0 = wiersze[w] * TRANSPOZYCJA_PAS, mi = z->n - i0 < TRANSPOZYCJA_PAS ? z->n - i0 : TRANSPOZYCJA_PAS;
+        for (int j0 = i0; j0 < z->n; j0 += TRANSPOZYCJA_PAS) {
+            int nj = z->n - j0 < TRANSPOZYCJA_PAS ? z->n - j0 : TRANSPOZYCJA_PAS;
+            char *aij = z->mat + ((long)i0 * z->n + j0) * el, *aji = z->mat + ((long)j0 * z->n + i0) * el;
+            // bufor = A_IJ^ (nj x mi), A_IJ = A_JI^, A_JI = bufor; na przekatnej aij == aji
+            transponuj_blok(aij, z->n, bufor, mi, mi, nj, z->zespolona);
+            if (j0 != i0) transponuj_blok(aji, z->n, aij, z->n, nj, mi, z->zespolona);
+            for (int r = 0; r < nj; ++r) memcpy(aji + (long)r * z->n * el, (char *)bufor + (long)r * mi * el, (size_t)(mi * el));
+        }
+    }
+}
+static void kwadrat_w_miejscu(void *mat, int n, int zespolona) {
+    int kafle = (n + TRANSPOZYCJA_PAS - 1) / TRANSPOZYCJA_PAS;
+    ZadanieZamiany z = { mat, n, kafle, zespolona };
+    rownolegle((kafle + 1) / 2, zamiana_blokow, &z);
+}
+// Macierz r x c o elementach po el bajtow: podazanie za cyklami permutacji i -> (i % c) * r + i / c,
+// odwiedzone pozycje w mapie bitowej (r * c bitow).
+static int transpozycja_cykle(char *a, long r, long c, size_t el) {
+    long n = r * c;
+    uint64_t *odw = calloc((size_t)(n + 63) / 64, sizeof(uint64_t));
+    char *tmp = malloc(el);
+    if (!odw || !tmp) { free(odw); free(tmp); return 4; }
+    for (long s = 1; s < n - 1; ++s) {
+        if (odw[s >> 6] >> (s & 63) & 1) continue;
+        memcpy(tmp, a + s * el, el);
+        long cur = s;
+        for (;;) {
+            long src = (cur % r) * c + cur / r;     // pozycja (i, j) trafia na j * r + i
+            odw[cur >> 6] |= 1ull << (cur & 63);
+            if (src == s) break;
+            memcpy(a + cur * el, a + src * el, el);
+            cur = src;
+        }
+        memcpy(a + cur * el, tmp, el);
+    }
+    free(odw); free(tmp);
+    return 0;
+}
+// Prostokat bez podzielnych wymiarow i ponizej tego rozmiaru idzie przez bufor (szybciej niz cykle).
+#define TRANSPOZYCJA_BUFOR ((size_t)64 << 20)
+// Ponizej tego NWD wymiarow segmenty bylyby za krotkie i lepsze sa cykle po elementach.
+#define TRANSPOZYCJA_NWD_MIN 16
+// Transpozycja w miejscu. Kwadrat: zamiany blokow. Gdy jeden wymiar jest wielokrotnoscia drugiego,
+// macierz to q kwadratow: kazdy transponowany w miejscu, a calymi wierszami kwadratow (ciaglymi
+// segmentami) przestawia sie cykle transpozycji q x c. Wieksze prostokaty rozklada sie na bloki
+// NWD x NWD; gdy NWD jest male, zostaja cykle po elementach.
+static int transpozycja_w_miejscu(void *mat, int rows, int cols, int zespolona) {
+    size_t el = zespolona ? sizeof(Complex) : sizeof(float);
+    if (rows == 1 || cols == 1) return 0;
+    if (rows == cols) { kwadrat_w_miejscu(mat, rows, zespolona); return 0; }
+    if (rows % cols == 0) {
+        long q = rows / cols, kw = (long)cols * cols * (long)el;
+        for (long b = 0; b < q; ++b) kwadrat_w_miejscu((char *)mat + b * kw, cols, zespolona);
+        return transpozycja_cykle(mat, q, cols, (size_t)cols * el);
+    }
+    if (cols % rows == 0) {
+        long q = cols / rows, kw = (long)rows * rows * (long)el;
+        int kod = transpozycja_cykle(mat, rows, q, (size_t)rows * el);
+        for (long b = 0; b < q && !kod; ++b) kwadrat_w_miejscu((char *)mat + b * kw, rows, zespolona);
+        return kod;
+    }
+    size_t rozmiar = (size_t)rows * cols * el;
+    void *tmp = rozmiar <= TRANSPOZYCJA_BUFOR ? malloc(rozmiar) : NULL;
+    if (tmp) {
+        transpozycja(mat, tmp, rows, cols, zespolona);
+        memcpy(mat, tmp, rozmiar);
+        free(tmp);
+        return 0;
+    }
+    long g = rows, h = cols;
+    while (h) { long t = g % h; g = h; h = t; }
+    if (g < TRANSPOZYCJA_NWD_MIN) return transpozycja_cykle(mat, rows, cols, el);
+    // Siatka a x b blokow g x g (g = NWD wymiarow), wszystkie przestawienia na ciaglych segmentach.
+    long a = rows / g, b = cols / g;
+    size_t blok = (size_t)(g * g) * el;
+    char *m = mat;
+    int kod = 0;
+    // 1) pas g wierszy (g x c) w miejscu -> b ciaglych blokow juz transponowanych
+    for (long i = 0; i < a && !kod; ++i) kod = transpozycja_w_miejscu(m + (size_t)i * blok * b, (int)g, cols, zespolona);
+    // 2) bloki jako elementy: siatka a x b -> b x a
+    if (!kod) kod = transpozycja_cykle(m, a, b, blok);
+    // 3) w pasie wyniku a blokow lezy jeden pod drugim; ich wiersze wracaja obok siebie (segmenty a x g -> g x a)
+    for (long j = 0; j < b && !kod; ++j) kod = transpozycja_cykle(m + (size_t)j * blok * a, a, g, (size_t)g * el);
+    return kod;
+}
+int transpose_float_inplace(float *mat, int rows, int cols) {
+    return transpozycja_w_miejscu(mat, rows, cols, 0);
+}
+int save_matrix_float(const char *filename, const float *mat, int rows, int cols) {
+    if (nazwa_binarna(filename)) return zapisz_binarnie(filename, TYP_FLOAT, mat, rows, cols);
+    return zapisz_plik_tekstowy(filename, TYP_FLOAT, mat, rows, cols);
+}
+
+// --- Funkcje dla macierzy zespolonych ---
+// W tokenach zespolonych '*' jest ignorowana (np. "3+4*i"), wiec przy przycinaniu zakresu
+// traktujemy ja jak bialy znak; liczby z '*' w srodku ida wolna sciezka przez kopie bez gwiazdek.
+static inline int pomijany_znak(char c) { return c == '*' || bialy_znak(c); }
+// Liczba z poczatku zakresu jak sscanf("%f"): 1 gdy sie udalo.
+static int parsuj_prefiks_complex(const char *s, const char *e, float *out) {
+    while (s < e && pomijany_znak(*s)) s++;
+    if (!memchr(s, '*', (size_t)(e - s)) && parsuj_float_szybko(s, e, out)) return 1;
+    char stos[TOKEN_STOS];
+    size_t n = (size_t)(e - s);
+    char *t = n < TOKEN_STOS ? stos : malloc(n + 1);
+    if (!t) return 0;
+    size_t k = 0;
+    for (const char *p = s; p < e; ++p) if (*p != '*') t[k++] = *p;
+    t[k] = '\0';
+    int ok = (sscanf(t, "%f", out) == 1);
+    if (t != stos) free(t);
+    return ok;
+}
+// Jak parsuj_prefiks_complex, ale do double (--precision f64).
+static int parsuj_prefiks_d(const char *s, const char *e, double *out) {
+    while (s < e && pomijany_znak(*s)) s++;
+    char stos[TOKEN_STOS];
+    size_t n = (size_t)(e - s);
+    char *t = n < TOKEN_STOS ? stos : malloc(n + 1);
+    if (!t) return 0;
+    size_t k = 0;
+    for (const char *p = s; p < e; ++p) if (*p != '*') t[k++] = *p;
+    t[k] = '\0';
+    int ok = (sscanf(t, "%lf", out) == 1);
+    if (t != stos) free(t);
+    return ok;
+}
+// Czesc liczby zespolonej jako float (wynik dokladny w double) albo double.
+static int parsuj_czesc(const char *s, const char *e, int podwojna, double *out) {
+    if (podwojna) return parsuj_prefiks_d(s, e, out);
+    float f;
+    if (!parsuj_prefiks_complex(s, e, &f)) return 0;
+    *out = f;
+    return 1;
+}
+// Parsuje token zespolony z [s, e): "a+b*i", "a-b*i", "b*i", "i", "-i", "a". Czesci w double;
+// przy podwojna == 0 sa to wartosci float (tak samo zaokraglone jak parsowane wprost do float).
+static int parsuj_complex_gen(const char *s, const char *e, int podwojna, double *re, double *im) {
+    while (s < e && bialy_znak(*s)) s++;
+    while (e > s && bialy_znak(e[-1])) e--;
+    const char *i_ptr = memchr(s, 'i', (size_t)(e - s));
+    if (!i_ptr) {
+        if (!parsuj_czesc(s, e, podwojna, re)) return 0;
+        *im = 0.0;
+        return 1;
+    }
+    e = i_ptr;
+    while (s < e && pomijany_znak(*s)) s++;
+    while (e > s && pomijany_znak(e[-1])) e--;
+    if (s == e) { *re = 0.0; *im = 1.0; return 1; }
+    const char *sep = NULL;
+    // znak tuz po 'e' nalezy do wykladnika (np. "1e-3-2.5e-06*i"), nie oddziela czesci
+    for (const char *p = s + 1; p < e; ++p) if ((*p == '+' || *p == '-') && p[-1] != 'e' && p[-1] != 'E') sep = p;
+    if (sep) {
+        const char *re_e = sep, *im_s = sep + 1;
+        while (re_e > s && pomijany_znak(re_e[-1])) re_e--;
+        while (im_s < e && pomijany_znak(*im_s)) im_s++;
+        if (re_e == s) *re = 0.0;
+        else if (!parsuj_czesc(s, re_e, podwojna, re)) return 0;
+        double imv;
+        if (im_s == e) imv = 1.0; else if (!parsuj_czesc(im_s, e, podwojna, &imv)) return 0;
+        if (*sep == '-') imv = -imv;
+        *im = imv;
+        return 1;
+    }
+    double imv;
+    if (parsuj_czesc(s, e, podwojna, &imv)) {
+        *re = 0.0; *im = imv; return 1;
+    }
+    *re = 0.0; *im = (*s == '-') ? -1.0 : 1.0;
+    return 1;
+}
+static int parsuj_complex(const char *s, const char *e, Complex *out) {
+    double re, im;
+    if (!parsuj_complex_gen(s, e, 0, &re, &im)) return 0;
+    out->re = (float)re; out->im = (float)im;
+    return 1;
+}
+int parse_complex(const char *str, Complex *out) {
+    return parsuj_complex(str, str + strlen(str), out);
+}
+int wczytaj_macierz_complex(const char *nazwa_pliku, Complex **pmat, int *prows, int *pcols) {
+    Operand o;
+    int kod = wczytaj_operand(nazwa_pliku, TYP_COMPLEX, 0.0, &o);
+    if (kod == 0) { *pmat = o.dane; *prows = o.rows; *pcols = o.cols; }
+    return kod;
+}
+void wypisz_macierz_complex(const Complex *mat, int rows, int cols) {
+    fflush(stdout);
+    zapisz_tekstowo(STDOUT_FILENO, TYP_COMPLEX, mat, rows, cols);
+}
+int save_matrix_complex(const char *filename, const Complex *mat, int rows, int cols) {
+    if (nazwa_binarna(filename)) return zapisz_binarnie(filename, TYP_COMPLEX, mat, rows, cols);
+    return zapisz_plik_tekstowy(filename, TYP_COMPLEX, mat, rows, cols);
+}
+// Complex to dwa floaty bez wypelnienia, wiec dodawanie/odejmowanie idzie jadrami rzeczywistymi na 2n elementach.
+void dodaj_macierze_complex(const Complex *a, const Complex *b, Complex *wynik, int rows, int cols) {
+    dolicz_flop(2.0 * rows * cols);
+    ew_rownolegle(jadra.dodaj, (const float *)a, (const float *)b, (float *)wynik, (size_t)rows * cols * 2);
+}
+void odejmij_macierze_complex(const Complex *a, const Complex *b, Complex *wynik, int rows, int cols) {
+    dolicz_flop(2.0 * rows * cols);
+    ew_rownolegle(jadra.odejmij, (const float *)a, (const float *)b, (float *)wynik, (size_t)rows * cols * 2);
+}
+// Zespolone C[M x N] = alpha * A * B (+ C gdy akumuluj), kolejnosc i-k-j: kazdy element A
+// skaluje spakowany wiersz B (caxpy), a blok wiersza C zostaje w L1 przez cala petle po k.
+// Zadaniem puli jest kafelek C (CGEMM_MT wierszy x CGEMM_NC kolumn).
+#define CGEMM_KC 256
+#define CGEMM_NC 512
+#define CGEMM_MT 64
+typedef struct {
+    int m, n, k;
+    Complex alpha;
+    const Complex *a, *b;
+    long rsa, csa, rsb, csb;
+    int akumuluj;
+    Complex *c;
+    long ldc;
+    int kafle_n, blad;
+} ZadanieCgemm;
+static void cgemm_kafelek(void *ctx, long t) {
+    ZadanieCgemm *z = ctx;
+    int i0 = (int)(t / z->kafle_n) * CGEMM_MT, jc = (int)(t % z->kafle_n) * CGEMM_NC;
+    int m = z->m - i0 < CGEMM_MT ? z->m - i0 : CGEMM_MT;
+    int nc = z->n - jc < CGEMM_NC ? z->n - jc : CGEMM_NC;
+    int kmax = z->k < CGEMM_KC ? z->k : CGEMM_KC;
+    Complex *bbuf = (Complex *)bufor_watku(&bufor_b, &bufor_b_n, (size_t)kmax * nc * 2);
+    if (!bbuf) { z->blad = 1; return; }
+    for (int pc = 0; pc < z->k; pc += CGEMM_KC) {
+        int kc = z->k - pc < CGEMM_KC ? z->k - pc : CGEMM_KC;
+        for (int p = 0; p < kc; ++p) {
+            const Complex *src = z->b + (long)(pc + p) * z->rsb + (long)jc * z->csb;
+            Complex *dst = bbuf + (long)p * nc;
+            if (z->csb == 1) memcpy(dst, src, (size_t)nc * sizeof(Complex));
+            else for (int j = 0; j < nc; ++j) dst[j] = src[(long)j * z->csb];
+        }
+        for (int i = i0; i < i0 + m; ++i) {
+            Complex *crow = z->c + (long)i * z->ldc + jc;
+            const Complex *arow = z->a + (long)i * z->rsa + (long)pc * z->csa;
+            for (int p = 0; p < kc; ++p) {
+                Complex av = arow[(long)p * z->csa];
+                Complex s = { z->alpha.re * av.re - z->alpha.im * av.im, z->alpha.re * av.im + z->alpha.im * av.re };
+                jadra.caxpy((size_t)nc, s, bbuf + (long)p * nc, crow);
+            }
+        }
+    }
+}
+// Zespolone C = alpha * A * B (+ C) w double dla Complex albo ComplexD (kroki w elementach zespolonych):
+// cztery gemm_d na widokach czesci re/im (krok 2 w liczbach rzeczywistych) do plaszczyzn double,
+// Re = ArBr - AiBi, Im = ArBi + AiBr, a alpha i akumulacja przy jednym zaokragleniu na koniec.
+static int cgemm_d(int m, int n, int k, ComplexD alpha, const void *a, int a_f32, long rsa, long csa,
+                   const void *b, int b_f32, long rsb, long csb, int akumuluj, void *c, int c_f32, long ldc) {
+    if (m <= 0 || n <= 0) return 0;
+    size_t nc = (size_t)m * n;
+    double *re = malloc(2 * nc * sizeof(double)), *im = re + nc;
+    if (!re) return 1;
+    const char *ar = a, *ai = ar + (a_f32 ? sizeof(float) : sizeof(double));
+    const char *br = b, *bi = br + (b_f32 ? sizeof(float) : sizeof(double));
+    rsa *= 2; csa *= 2; rsb *= 2; csb *= 2;
+    int kod = gemm_d(m, n, k, 1.0, ar, a_f32, rsa, csa, br, b_f32, rsb, csb, 0, re, 0, n)
+           || gemm_d(m, n, k, -1.0, ai, a_f32, rsa, csa, bi, b_f32, rsb, csb, 1, re, 0, n)
+           || gemm_d(m, n, k, 1.0, ar, a_f32, rsa, csa, bi, b_f32, rsb, csb, 0, im, 0, n)
+           || gemm_d(m, n, k, 1.0, ai, a_f32, rsa, csa, br, b_f32, rsb, csb, 1, im, 0, n);
+    for (int i = 0; i < m && !kod; ++i)
+        for (int j = 0; j < n; ++j) {
+            double xr = re[(size_t)i * n + j], xi = im[(size_t)i * n + j];
+            double wr = alpha.re * xr - alpha.im * xi, wi = alpha.re * xi + alpha.im * xr;
+            if (c_f32) {
+                Complex *w = (Complex *)c + (long)i * ldc + j;
+                if (akumuluj) { wr += w->re; wi += w->im; }
+                w->re = (float)wr; w->im = (float)wi;
+            } else {
+                ComplexD *w = (ComplexD *)c + (long)i * ldc + j;
+                if (akumuluj) { wr += w->re; wi += w->im; }
+                w->re = wr; w->im = wi;
+            }
+        }
+    free(re);
+    return kod;
+}
+static int gemm_c32(int m, int n, int k, Complex alpha,
+                    const Complex *a, long rsa, long csa, const Complex *b, long rsb, long csb,
+                    int akumuluj, Complex *c, long ldc) {
+    if (precyzja == PRECYZJA_MIESZANA) {
+        ComplexD al = { alpha.re, alpha.im };
+        return cgemm_d(m, n, k, al, a, 1, rsa, csa, b, 1, rsb, csb, akumuluj, c, 1, ldc);
+    }
+    if (m <= 0 || n <= 0) return 0;
+    if (!akumuluj) for (int i = 0; i < m; ++i) memset(c + (long)i * ldc, 0, (size_t)n * sizeof(Complex));
+    if (k <= 0) return 0;
+    ZadanieCgemm z = { m, n, k, alpha, a, b, rsa, csa, rsb, csb, akumuluj, c, ldc, (n + CGEMM_NC - 1) / CGEMM_NC, 0 };
+    rownolegle((long)((m + CGEMM_MT - 1) / CGEMM_MT) * z.kafle_n, cgemm_kafelek, &z);
+    return z.blad;
+}
+void transpose_complex(const Complex *src, Complex *dst, int rows, int cols) {
+    transpozycja(src, dst, rows, cols, 1);
+}
+int transpose_complex_inplace(Complex *mat, int rows, int cols) {
+    return transpozycja_w_miejscu(mat, rows, cols, 1);
+}
+
+// --- Szybkie mnozenie: Strassen-Winograd i 3M ---
+// Dodawanie na widokach z krokami wierszy (w floatach); wiersze zespolone to pary floatow,
+// wiec ta sama funkcja dodaje macierze zespolone (n = 2 * kolumny).
+#define WIDOK_PAS 64
+typedef struct { int m, n; const float *a, *b; float *c; long lda, ldb, ldc; int minus; } ZadanieWidoku;
+static void suma_widoku_pas(void *ctx, long t) {
+    ZadanieWidoku *z = ctx;
+    int i1 = (int)(t + 1) * WIDOK_PAS < z->m ? (int)(t + 1) * WIDOK_PAS : z->m;
+    for (int i = (int)t * WIDOK_PAS; i < i1; ++i)
+        (z->minus ? jadra.odejmij : jadra.dodaj)(z->a + (long)i * z->lda, z->b + (long)i * z->ldb, z->c + (long)i * z->ldc, (size_t)z->n);
+}
+static void suma_widoku(int m, int n, const float *a, long lda, const float *b, long ldb, float *c, long ldc, int minus) {
+    ZadanieWidoku z = { m, n, a, b, c, lda, ldb, ldc, minus };
+    rownolegle((m + WIDOK_PAS - 1) / WIDOK_PAS, suma_widoku_pas, &z);
+}
+static int gemm_lisc(int m, int n, int k, const float *a, long lda, const float *b, long ldb, float *c, long ldc, int w) {
+    if (w == 1) return gemm_f32(m, n, k, 1.0f, a, lda, 1, b, ldb, 1, 0, c, ldc);
+    Complex jeden = { 1.0f, 0.0f };
+    return gemm_c32(m, n, k, jeden, (const Complex *)a, lda / 2, 1, (const Complex *)b, ldb / 2, 1, 0, (Complex *)c, ldc / 2);
+}
+// Jeden poziom wariantu Winograda (7 iloczynow, 15 dodawan) w kolejnosci z DGEFMM (Douglas i in.):
+// cwiartki C sluza za miejsce na iloczyny posrednie, poza nimi potrzebne sa tylko X (m/2 x k/2),
+// Y (k/2 x n/2) i Z (m/2 x n/2). Wymiary sa parzyste na kazdym z 'poziomy' poziomow.
+static int strassen_rek(int m, int n, int k, const float *a, long lda, const float *b, long ldb,
+                        float *c, long ldc, int w, int poziomy) {
+    if (poziomy == 0) return gemm_lisc(m, n, k, a, lda, b, ldb, c, ldc, w);
+    int m2 = m / 2, n2 = n / 2, k2 = k / 2, kw = k2 * w, nw = n2 * w;
+    const float *a11 = a, *a12 = a + kw, *a21 = a + (long)m2 * lda, *a22 = a21 + kw;
+    const float *b11 = b, *b12 = b + nw, *b21 = b + (long)k2 * ldb, *b22 = b21 + nw;
+    float *c11 = c, *c12 = c + nw, *c21 = c + (long)m2 * ldc, *c22 = c21 + nw;
+    float *x = alokuj_wyrownane((size_t)m2 * kw * sizeof(float));
+    float *y = alokuj_wyrownane((size_t)k2 * nw * sizeof(float));
+    float *z = alokuj_wyrownane((size_t)m2 * nw * sizeof(float));
+    int kod = !x || !y || !z;
+    if (!kod) {
+        --poziomy;
+        suma_widoku(m2, kw, a11, lda, a21, lda, x, kw, 1);             // S3 = A11 - A21
+        suma_widoku(k2, nw, b22, ldb, b12, ldb, y, nw, 1);             // T3 = B22 - B12
+        kod |= strassen_rek(m2, n2, k2, x, kw, y, nw, c21, ldc, w, poziomy);    // M7
+        suma_widoku(m2, kw, a21, lda, a22, lda, x, kw, 0);             // S1 = A21 + A22
+        suma_widoku(k2, nw, b12, ldb, b11, ldb, y, nw, 1);             // T1 = B12 - B11
+        kod |= strassen_rek(m2, n2, k2, x, kw, y, nw, c22, ldc, w, poziomy);    // M5
+        suma_widoku(m2, kw, x, kw, a11, lda, x, kw, 1);                // S2 = S1 - A11
+        suma_widoku(k2, nw, b22, ldb, y, nw, y, nw, 1);                // T2 = B22 - T1
+        kod |= strassen_rek(m2, n2, k2, x, kw, y, nw, c12, ldc, w, poziomy);    // M6
+        suma_widoku(m2, kw, a12, lda, x, kw, x, kw, 1);                // S4 = A12 - S2
+        kod |= strassen_rek(m2, n2, k2, x, kw, b22, ldb, c11, ldc, w, poziomy); // M3
+        kod |= strassen_rek(m2, n2, k2, a11, lda, b11, ldb, z, nw, w, poziomy); // M1
+        suma_widoku(m2, nw, z, nw, c12, ldc, c12, ldc, 0);             // U2 = M1 + M6
+        suma_widoku(m2, nw, c12, ldc, c21, ldc, c21, ldc, 0);          // U3 = U2 + M7
+        suma_widoku(m2, nw, c12, ldc, c22, ldc, c12, ldc, 0);          // U4 = U2 + M5
+        suma_widoku(m2, nw, c21, ldc, c22, ldc, c22, ldc, 0);          // C22 = U3 + M5
+        suma_widoku(m2, nw, c12, ldc, c11, ldc, c12, ldc, 0);          // C12 = U4 + M3
+        suma_widoku(k2, nw, y, nw, b21, ldb, y, nw, 1);                // T4 = T2 - B21
+        kod |= strassen_rek(m2, n2, k2, a22, lda, y, nw, c11, ldc, w, poziomy); // M4
+        suma_widoku(m2, nw, c21, ldc, c11, ldc, c21, ldc, 1);          // C21 = U3 - M4
+        kod |= strassen_rek(m2, n2, k2, a12, lda, b21, ldb, c11, ldc, w, poziomy); // M2
+        suma_widoku(m2, nw, c11, ldc, z, nw, c11, ldc, 0);             // C11 = M2 + M1
+    }
+    free(x); free(y); free(z);
+    return kod;
+}
+// C = A * B (gesto, wierszami). Liczba poziomow tak, zeby liscie mialy najmniejszy wymiar <= prog;
+// wymiary niepodzielne przez 2^poziomy sa dopelniane zerami na kopiach.
+static int strassen(int m, int n, int k, const void *a, const void *b, void *c, int zespolona, int prog) {
+    int w = zespolona ? 2 : 1, poziomy = 0;
+    long pm = m, pn = n, pk = k;
+    while (pm > prog && pn > prog && pk > prog) { pm = (pm + 1) / 2; pn = (pn + 1) / 2; pk = (pk + 1) / 2; poziomy++; }
+    int M = (int)(pm << poziomy), N = (int)(pn << poziomy), K = (int)(pk << poziomy);
+    if (M == m && N == n && K == k)
+        return strassen_rek(m, n, k, a, (long)k * w, b, (long)n * w, c, (long)n * w, w, poziomy);
+    size_t el = (size_t)w * sizeof(float);
+    char *ap = alokuj_wyrownane((size_t)M * K * el), *bp = alokuj_wyrownane((size_t)K * N * el), *cp = alokuj_wyrownane((size_t)M * N * el);
+    int kod = !ap || !bp || !cp;
+    if (!kod) {
+        memset(ap, 0, (size_t)M * K * el); memset(bp, 0, (size_t)K * N * el);
+        for (int i = 0; i < m; ++i) memcpy(ap + (size_t)i * K * el, (const char *)a + (size_t)i * k * el, (size_t)k * el);
+        for (int i = 0; i < k; ++i) memcpy(bp + (size_t)i * N * el, (const char *)b + (size_t)i * n * el, (size_t)n * el);
+        kod = strassen_rek(M, N, K, (float *)ap, (long)K * w, (float *)bp, (long)N * w, (float *)cp, (long)N * w, w, poziomy);
+        for (int i = 0; i < m && !kod; ++i) memcpy((char *)c + (size_t)i * n * el, cp + (size_t)i * N * el, (size_t)n * el);
+    }
+    free(ap); free(bp); free(cp);
+    return kod;
+}
+static int mnoz_rzeczywiste(int m, int n, int k, const float *a, const float *b, float *c, int prog) {
+    if (prog > 0) return strassen(m, n, k, a, b, c, 0, prog);
+    return gemm_f32(m, n, k, 1.0f, a, k, 1, b, n, 1, 0, c, n);
+}
+
+// --- Uklad planarny liczb zespolonych ---
+// Macierz zespolona jako dwie plaszczyzny float: re[] i zaraz za nia im[] (jedna alokacja 2 * n).
+// Iloczyn to wtedy cztery (albo trzy, --3m) zwykle GEMM float, bez przetasowan par re/im w jadrach;
+// uklad zmienia sie tylko przy wczytaniu i zapisie.
+typedef struct { const Complex *z; Complex *zw; float *re, *im; const float *t; size_t n; int krok; } ZadaniePlanow;
+static void zadanie_planow(void *ctx, long i) {
+    ZadaniePlanow *z = ctx;
+    size_t lo = (size_t)i * EW_ZAKRES, hi = lo + EW_ZAKRES < z->n ? lo + EW_ZAKRES : z->n;
+    if (z->krok == 0) for (size_t j = lo; j < hi; ++j) { z->re[j] = z->z[j].re; z->im[j] = z->z[j].im; }
+    else if (z->krok == 1) for (size_t j = lo; j < hi; ++j) { z->zw[j].re = z->re[j]; z->zw[j].im = z->im[j]; }
+    else for (size_t j = lo; j < hi; ++j) {
+        // 3M: re = T1, im = T2, t = T3 -> Re = T1 - T2, Im = T3 - (T1 + T2)
+        float t1 = z->re[j], t2 = z->im[j];
+        z->re[j] = t1 - t2; z->im[j] = z->t[j] - (t1 + t2);
+    }
+}
+static void plany_krok(ZadaniePlanow z) { rownolegle((long)((z.n + EW_ZAKRES - 1) / EW_ZAKRES), zadanie_planow, &z); }
+// Nowa tablica planarna (re, potem im) z n elementow Complex; NULL przy braku pamieci.
+static float *na_plany(const Complex *z, size_t n) {
+    float *p = alokuj_wyrownane(2 * n * sizeof(float));
+    if (p) plany_krok((ZadaniePlanow){ z, NULL, p, p + n, NULL, n, 0 });
+    return p;
+}
+static void z_planow(const float *p, Complex *z, size_t n) {
+    plany_krok((ZadaniePlanow){ NULL, z, (float *)p, (float *)p + n, NULL, n, 1 });
+}
+// C = A * B na plaszczyznach (macierze wierszami, A: m x k, B: k x n). Bez Strassena i 3M czesci
+// wyniku akumuluja sie wprost w C: Re = ArBr - AiBi, Im = ArBi + AiBr. 3M (Gauss) nadpisuje Ar i Br
+// sumami Ar + Ai i Br + Bi.
+static int mnoz_plany(int m, int n, int k, float *a, float *b, float *c, int prog, int trzy) {
+    size_t na = (size_t)m * k, nb = (size_t)k * n, nc = (size_t)m * n;
+    float *ar = a, *ai = a + na, *br = b, *bi = b + nb, *cr = c, *ci = c + nc;
+    if (!trzy && prog <= 0)
+        return gemm_f32(m, n, k, 1.0f, ar, k, 1, br, n, 1, 0, cr, n) | gemm_f32(m, n, k, -1.0f, ai, k, 1, bi, n, 1, 1, cr, n)
+             | gemm_f32(m, n, k, 1.0f, ar, k, 1, bi, n, 1, 0, ci, n) | gemm_f32(m, n, k, 1.0f, ai, k, 1, br, n, 1, 1, ci, n);
+    float *t = alokuj_wyrownane(nc * sizeof(float));
+    if (!t) return 1;
+    int kod;
+    if (trzy) {
+        kod = mnoz_rzeczywiste(m, n, k, ar, br, cr, prog) | mnoz_rzeczywiste(m, n, k, ai, bi, ci, prog);
+        ew_rownolegle(jadra.dodaj, ar, ai, ar, na);
+        ew_rownolegle(jadra.dodaj, br, bi, br, nb);
+        kod |= mnoz_rzeczywiste(m, n, k, ar, br, t, prog);
+        if (!kod) plany_krok((ZadaniePlanow){ NULL, NULL, cr, ci, t, nc, 2 });
+    } else {
+        kod = mnoz_rzeczywiste(m, n, k, ar, br, cr, prog) | mnoz_rzeczywiste(m, n, k, ai, bi, t, prog);
+        ew_rownolegle(jadra.odejmij, cr, t, cr, nc);
+        kod |= mnoz_rzeczywiste(m, n, k, ar, bi, ci, prog) | mnoz_rzeczywiste(m, n, k, ai, br, t, prog);
+        ew_rownolegle(jadra.dodaj, ci, t, ci, nc);
+    }
+    free(t);
+    return kod;
+}
+// Iloczyn w ukladzie Complex przez kopie planarne (wejscia sa stale); 1 przy braku pamieci.
+static int mnoz_przez_plany(int m, int n, int k, const Complex *a, const Complex *b, Complex *c, int prog, int trzy) {
+    float *ap = na_plany(a, (size_t)m * k), *bp = ap ? na_plany(b, (size_t)k * n) : NULL;
+    float *cp = bp ? alokuj_wyrownane(2 * (size_t)m * n * sizeof(float)) : NULL;
+    int kod = !cp || mnoz_plany(m, n, k, ap, bp, cp, prog, trzy);
+    if (!kod) z_planow(cp, c, (size_t)m * n);
+    free(ap); free(bp); free(cp);
+    return kod;
+}
+// Jak mnoz_macierze: 1 przy zlych wymiarach, 4 przy braku pamieci na bufory.
+int mnoz_macierze_complex(const Complex *a, int a_rows, int a_cols, const Complex *b, int b_rows, int b_cols, Complex *wynik) {
+    if (a_cols != b_rows) return 1;
+    dolicz_flop(8.0 * a_rows * a_cols * b_cols);
+    // mixed: uklad przeplatany (cgemm_d), zeby suma ArBr - AiBi tez byla liczona w double
+    int plany = (uklad_planarny && precyzja != PRECYZJA_MIESZANA) || mnozenie_3m;
+    if (plany && mnoz_przez_plany(a_rows, b_cols, a_cols, a, b, wynik, prog_strassena, mnozenie_3m) == 0) return 0;
+    if (prog_strassena > 0 && strassen(a_rows, b_cols, a_cols, a, b, wynik, 1, prog_strassena) == 0) return 0;
+    Complex jeden = { 1.0f, 0.0f };
+    return gemm_c32(a_rows, b_cols, a_cols, jeden, a, a_cols, 1, b, b_cols, 1, 0, wynik, b_cols) ? 4 : 0;
+}
+// Zapis binarny z plaszczyzn: naglowek, potem paczki zlozone do Complex.
+static int zapisz_plany_binarnie(const char *filename, const float *p, int rows, int cols) {
+    NaglowekBin h;
+    wypelnij_naglowek(&h, TYP_COMPLEX, rows, cols);
+    size_t n = (size_t)rows * cols, paczka = (size_t)1 << 16;
+    Complex *buf = malloc(paczka * sizeof(Complex));
+    int fd = buf ? open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    int wynik = fd < 0 || zapisz_wszystko(fd, (const char *)&h, sizeof(h));
+    for (size_t i = 0; i < n && !wynik; i += paczka) {
+        size_t ile = n - i < paczka ? n - i : paczka;
+        for (size_t j = 0; j < ile; ++j) { buf[j].re = p[i + j]; buf[j].im = p[n + i + j]; }
+        wynik = zapisz_wszystko(fd, (const char *)buf, ile * sizeof(Complex));
+    }
+    if (fd >= 0 && close(fd) != 0) wynik = 1;
+    free(buf);
+    return wynik;
+}
+// Iloczyn gestych rzeczywista x zespolona (c: m x n Complex) bez rozszerzania argumentu float:
+// plaszczyzny argumentu zespolonego mnozone sa przez rzeczywisty, czyli 2 iloczyny rzeczywiste
+// zamiast 4. Dla zespolonej A plaszczyzny [Ar; Ai] to jedna macierz 2m x k i jedno mnozenie.
+static int iloczyn_mieszany(int m, int n, int k, const void *a, int a_zespolona, const void *b, Complex *c) {
+    size_t nc = (size_t)m * n;
+    float *cp = alokuj_wyrownane(2 * nc * sizeof(float)), *pl = NULL;
+    dolicz_flop(4.0 * m * n * k);
+    int kod = !cp;
+    if (!kod && a_zespolona) {
+        kod = (pl = na_plany(a, (size_t)m * k)) == NULL || mnoz_rzeczywiste(2 * m, n, k, pl, b, cp, prog_strassena);
+    } else if (!kod) {
+        size_t nb = (size_t)k * n;
+        kod = (pl = na_plany(b, nb)) == NULL || mnoz_rzeczywiste(m, n, k, a, pl, cp, prog_strassena)
+              || mnoz_rzeczywiste(m, n, k, a, pl + nb, cp + nc, prog_strassena);
+    }
+    if (!kod) z_planow(cp, c, nc);
+    free(pl); free(cp);
+    return kod ? 4 : 0;
+}
+// Mnozenie zespolone z main na plaszczyznach. Argumenty przechodza na uklad planarny po kolei
+// (oryginal jest zwalniany zaraz po konwersji), wynik jest wypisywany i zapisywany z plaszczyzn.
+// -1: zabraklo pamieci przed zwolnieniem czegokolwiek - wtedy zostaje zwykla sciezka.
+static int iloczyn_planarny(Complex *mat1, int rows1, int cols1, Complex *mat2, int cols2, const char *outfile, int cichy) {
+    size_t na = (size_t)rows1 * cols1, nb = (size_t)cols1 * cols2, nc = (size_t)rows1 * cols2;
+    float *ap = na_plany(mat1, na);
+    if (!ap) return -1;
+    zwolnij_macierz(mat1);
+    float *bp = na_plany(mat2, nb);
+    zwolnij_macierz(mat2);
+    float *cp = bp ? alokuj_wyrownane(2 * nc * sizeof(float)) : NULL;
+    dolicz_flop(8.0 * rows1 * cols1 * cols2);
+    int kod = !cp || mnoz_plany(rows1, cols2, cols1, ap, bp, cp, prog_strassena, mnozenie_3m);
+    free(ap); free(bp);
+    if (kod) { fprintf(stderr, "Brak pamieci!\n"); free(cp); return 1; }
+    if (!cichy) {
+        printf("Iloczyn macierzy:\n");
+        fflush(stdout);
+        zapisz_tekst(STDOUT_FILENO, TYP_COMPLEX, cp, cp + nc, rows1, cols2);
+    }
+    if (outfile && (nazwa_binarna(outfile) ? zapisz_plany_binarnie(outfile, cp, rows1, cols2)
+                                           : zapisz_plik_tekst(outfile, TYP_COMPLEX, cp, cp + nc, rows1, cols2)))
+        fprintf(stderr, "Blad zapisu %s\n", outfile);
+    free(cp);
+    return 0;
+}
+
+// --- Konwersja formatow ---
+// Format wyjscia wynika z rozszerzenia (.bin - binarny, inne - tekstowy), wejscie jest rozpoznawane.
+static int konwertuj(const char *wejscie, const char *wyjscie) {
+    Operand o;
+    if (wczytaj_operand(wejscie, TYP_AUTO, 0.0, &o) != 0) { fprintf(stderr, "Blad wczytywania %s\n", wejscie); return 1; }
+    int wynik = o.zespolona ? save_matrix_complex(wyjscie, o.dane, o.rows, o.cols)
+                            : save_matrix_float(wyjscie, o.dane, o.rows, o.cols);
+    zwolnij_operand(&o);
+    if (wynik != 0) { fprintf(stderr, "Blad zapisu %s\n", wyjscie); return 1; }
+    return 0;
+}
+
+// --- Benchmark ---
+static void losuj_f32(float *m, size_t n) {
+    for (size_t i = 0; i < n; ++i) m[i] = (float)rand() / (float)RAND_MAX * 2.0f - 1.0f;
+}
+// Najwieksza roznica wzgledem wyniku klasycznego, odniesiona do najwiekszego elementu |C| (normowo,
+// jak w oszacowaniach bledu Strassena); n liczb float, zespolone jako pary.
+static double blad_normowy(const float *c, const float *c_klas, size_t n) {
+    double max_d = 0.0, max_c = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double d = fabs((double)c[i] - c_klas[i]), v = fabs((double)c_klas[i]);
+        if (d > max_d) max_d = d;
+        if (v > max_c) max_c = v;
+    }
+    return max_c > 0.0 ? max_d / max_c : max_d;
+}
+// Czas jednego wywolania (powtarzanego do ~0.2 s) mnozenia w danym trybie: 0 - klasyczny GEMM
+// (dla Complex na parach re/im), 1 - Strassen, 2 - plaszczyzny re/im, 3 - 3M, 4 - 3M ze Strassenem.
+static double czas_mnozenia(int tryb, int n, const float *a, const float *b, float *c, int zespolona, int prog) {
+    int powt = 0;
+    double t0 = czas_s(), t;
+    do {
+        if (tryb == 1) strassen(n, n, n, a, b, c, zespolona, prog);
+        else if (tryb >= 2) mnoz_przez_plany(n, n, n, (const Complex *)a, (const Complex *)b, (Complex *)c, tryb == 4 ? prog : 0, tryb >= 3);
+        else if (zespolona) { Complex jeden = { 1.0f, 0.0f }; gemm_c32(n, n, n, jeden, (const Complex *)a, n, 1, (const Complex *)b, n, 1, 0, (Complex *)c, n); }
+        else gemm_f32(n, n, n, 1.0f, a, n, 1, b, n, 1, 0, c, n);
+        ++powt;
+        t = czas_s() - t0;
+    } while (t < 0.2);
+    return t / powt;
+}
+// Strassen-Winograd, uklad planarny i 3M wobec klasycznego GEMM: czas i blad normowy. Rozmiary nieparzyste
+// sprawdzaja dopelnianie zerami.
+static int bench_szybkie(int n) {
+    int prog = prog_strassena > 0 ? prog_strassena : 512;
+    int rozmiary[] = { n, 2 * n - 1 };
+    const char *nazwy[] = { "", "Strassen", "planarny", "3M", "3M+Strassen" };
+    printf("\nMnozenie szybkie (prog Strassena %d) wobec klasycznego:\n", prog);
+    printf("%-22s %10s %10s %10s %12s\n", "typ, n, tryb", "klas. s", "szybkie s", "przysp.", "bl. normowy");
+    for (int zesp = 0; zesp < 2; ++zesp)
+        for (size_t r = 0; r < sizeof(rozmiary) / sizeof(rozmiary[0]); ++r) {
+            int m = rozmiary[r];
+            size_t ile = (size_t)m * m * (zesp ? 2 : 1);
+            float *a = malloc(ile * sizeof(float)), *b = malloc(ile * sizeof(float));
+            float *c_klas = malloc(ile * sizeof(float)), *c = malloc(ile * sizeof(float));
+            if (!a || !b || !c_klas || !c) { free(a); free(b); free(c_klas); free(c); return 1; }
+            losuj_f32(a, ile); losuj_f32(b, ile);
+            double t_klas = czas_mnozenia(0, m, a, b, c_klas, zesp, prog);
+            for (int tryb = 1; tryb <= 4; ++tryb) {
+                if (tryb >= 2 && !zesp) break;
+                double t = czas_mnozenia(tryb, m, a, b, c, zesp, prog);
+                char opis[64];
+                snprintf(opis, sizeof(opis), "%s %d %s", zesp ? "C" : "R", m, nazwy[tryb]);
+                printf("%-22s %10.3f %10.3f %9.2fx %12.2e\n", opis, t_klas, t, t_klas / t, blad_normowy(c, c_klas, ile));
+            }
+            free(a); free(b); free(c_klas); free(c);
+        }
+    return 0;
+}
+// Mierzy GFLOP/s silnika blokowego i petli referencyjnej dla ksztaltow kwadratowych i "chudych".
+static int bench_mnozenie(int n) {
+    int ksztalty[][3] = {
+        { n / 4, n / 4, n / 4 }, { n / 2, n / 2, n / 2 }, { n, n, n },
+        { n, 64, n }, { n, n, 16 }, { 16, n, n }, { n, n, 1 }
+    };
+    srand(12345);
+    printf("Jadra: %s, watki: %d\n", jadra.nazwa, pula.n);
+    printf("%-22s %10s %10s %10s %12s\n", "M x K x N", "ref GF/s", "blok GF/s", "przysp.", "max bl. wzgl.");
+    for (size_t s = 0; s < sizeof(ksztalty) / sizeof(ksztalty[0]); ++s) {
+        int m = ksztalty[s][0], k = ksztalty[s][1], nn = ksztalty[s][2];
+        if (m <= 0 || k <= 0 || nn <= 0) continue;
+        float *a = malloc((size_t)m * k * sizeof(float));
+        float *b = malloc((size_t)k * nn * sizeof(float));
+        float *c_ref = malloc((size_t)m * nn * sizeof(float));
+        float *c = malloc((size_t)m * nn * sizeof(float));
+        if (!a || !b || !c_ref || !c) { free(a); free(b); free(c_ref); free(c); return 1; }
+        losuj_f32(a, (size_t)m * k); losuj_f32(b, (size_t)k * nn);
+        double flop = 2.0 * m * k * nn;
+        double t0 = czas_s();
+        mnoz_macierze_ref(a, m, k, b, k, nn, c_ref);
+        double t_ref = czas_s() - t0;
+        int powt = 0, kod = 0; double t_blok = 0.0;
+        t0 = czas_s();
+        do { kod = mnoz_macierze(a, m, k, b, k, nn, c); ++powt; t_blok = czas_s() - t0; } while (!kod && t_blok < 0.2);
+        if (kod) { fprintf(stderr, "Brak pamieci!\n"); free(a); free(b); free(c_ref); free(c); return 1; }
+        t_blok /= powt;
+        double max_bl = 0.0;
+        for (size_t i = 0; i < (size_t)m * nn; ++i) {
+            double d = c[i] - c_ref[i]; if (d < 0) d = -d;
+            double r = c_ref[i] < 0 ? -c_ref[i] : c_ref[i];
+            d /= (r > 1.0 ? r : 1.0);
+            if (d > max_bl) max_bl = d;
+        }
+        char opis[64];
+        snprintf(opis, sizeof(opis), "%d x %d x %d", m, k, nn);
+        printf("%-22s %10.2f %10.2f %9.1fx %12.2e\n", opis, flop / t_ref * 1e-9, flop / t_blok * 1e-9, t_ref / t_blok, max_bl);
+        free(a); free(b); free(c_ref); free(c);
+    }
+    return bench_szybkie(n);
+}
+
+// Przeglad do wykrywania regresji miedzy wersjami: losowe macierze float i Complex w szeregu ksztaltow,
+// kazde dzialanie na kazdym dostepnym zestawie jader i kazdy wariant mnozenia; wynik jako CSV albo JSON.
+// Blad normowy iloczynow liczony wzgledem mnozenia blokowego na domyslnych jadrach.
+enum { PR_DODAJ, PR_ODEJMIJ, PR_TRANSP, PR_GEMM, PR_REF, PR_STRASSEN, PR_PLANY, PR_3M, PR_3M_STRASSEN, PR_FORMAT, PR_PARSOWANIE };
+typedef struct {
+    int m, k, n, zesp, prog, fd_null;
+    const float *a, *a2, *b;
+    float *c;
+    char plik[64];              // A jako tekst w pliku w pamieci (memfd) do pomiaru parsowania
+    int json, pierwszy;
+} Przeglad;
+
+static void przeglad_krok(const Przeglad *p, int d) {
+    size_t mk = (size_t)p->m * p->k * (p->zesp ? 2 : 1);
+    Complex jeden = { 1.0f, 0.0f };
+    Operand o;
+    switch (d) {
+    case PR_DODAJ: ew_rownolegle(jadra.dodaj, p->a, p->a2, p->c, mk); break;
+    case PR_ODEJMIJ: ew_rownolegle(jadra.odejmij, p->a, p->a2, p->c, mk); break;
+    case PR_TRANSP: transpozycja(p->a, p->c, p->m, p->k, p->zesp); break;
+    case PR_GEMM:
+        if (p->zesp) gemm_c32(p->m, p->n, p->k, jeden, (const Complex *)p->a, p->k, 1, (const Complex *)p->b, p->n, 1, 0, (Complex *)p->c, p->n);
+        else gemm_f32(p->m, p->n, p->k, 1.0f, p->a, p->k, 1, p->b, p->n, 1, 0, p->c, p->n);
+        break;
+    case PR_REF: mnoz_macierze_ref(p->a, p->m, p->k, p->b, p->k, p->n, p->c); break;
+    case PR_STRASSEN: strassen(p->m, p->n, p->k, p->a, p->b, p->c, p->zesp, p->prog); break;
+    case PR_PLANY: case PR_3M: case PR_3M_STRASSEN:
+        mnoz_przez_plany(p->m, p->n, p->k, (const Complex *)p->a, (const Complex *)p->b, (Complex *)p->c,
+                         d == PR_3M_STRASSEN ? p->prog : 0, d != PR_PLANY);
+        break;
+    case PR_FORMAT: zapisz_tekstowo(p->fd_null, p->zesp ? TYP_COMPLEX : TYP_FLOAT, p->a, p->m, p->k); break;
+    case PR_PARSOWANIE:
+        if (wczytaj_operand(p->plik, p->zesp ? TYP_COMPLEX : TYP_FLOAT, 0.0, &o) == 0) zwolnij_operand(&o);
+        break;
+    }
+}
+static double przeglad_czas(const Przeglad *p, int d) {
+    int powt = 0;
+    double t0 = czas_s(), t;
+    do { przeglad_krok(p, d); ++powt; t = czas_s() - t0; } while (t < 0.1);
+    return t / powt;
+}
+// Jeden wynik; blad NAN - nie dotyczy (pusta kolumna CSV, null w JSON).
+static void przeglad_wynik(Przeglad *p, const char *dzialanie, const char *wariant, double t, double flop, double bajty, double blad) {
+    const char *typ = p->zesp ? "complex" : "float";
+    if (p->json) {
+        printf("%s\n    {\"typ\": \"%s\", \"dzialanie\": \"%s\", \"wariant\": \"%s\", \"jadra\": \"%s\", \"m\": %d, \"k\": %d, \"n\": %d, "
+               "\"watki\": %d, \"czas_s\": %.6g, \"gflops\": %.6g, \"gbs\": %.6g, \"blad\": ",
+               p->pierwszy ? "" : ",", typ, dzialanie, wariant, jadra.nazwa, p->m, p->k, p->n, pula.n, t, flop / t * 1e-9, bajty / t * 1e-9);
+        if (isnan(blad)) printf("null}"); else printf("%.3g}", blad);
+    } else {
+        printf("%s,%s,%s,%s,%d,%d,%d,%d,%.6g,%.6g,%.6g,", typ, dzialanie, wariant, jadra.nazwa, p->m, p->k, p->n, pula.n,
+               t, flop / t * 1e-9, bajty / t * 1e-9);
+        if (!isnan(blad)) printf("%.3g", blad);
+        printf("\n");
+    }
+    p->pierwszy = 0;
+}
+static int bench_przeglad(int n, int json) {
+    int ksztalty[][3] = { { n / 4, n / 4, n / 4 }, { n / 2, n / 2, n / 2 }, { n, n, n }, { n, 64, n }, { n, n, 16 }, { 16, n, n } };
+    static const char *zestawy[] = { "scalar", "sse2", "avx2", "avx512" };
+    const char *domyslne = jadra.nazwa;
+    Przeglad p;
+    memset(&p, 0, sizeof(p));
+    p.json = json; p.pierwszy = 1;
+    p.prog = prog_strassena > 0 ? prog_strassena : (n / 4 > 32 ? n / 4 : 32);
+    if ((p.fd_null = open("/dev/null", O_WRONLY)) < 0) return 1;
+    srand(12345);
+    if (json) printf("{\"jadra\": \"%s\", \"watki\": %d, \"n\": %d, \"prog_strassena\": %d, \"wyniki\": [", domyslne, pula.n, n, p.prog);
+    else printf("typ,dzialanie,wariant,jadra,m,k,n,watki,czas_s,gflops,gbs,blad\n");
+    int kod = 0;
+    for (size_t s = 0; s < sizeof(ksztalty) / sizeof(ksztalty[0]) && !kod; ++s)
+        for (int zesp = 0; zesp < 2 && !kod; ++zesp) {
+            p.m = ksztalty[s][0]; p.k = ksztalty[s][1]; p.n = ksztalty[s][2]; p.zesp = zesp;
+            if (p.m <= 0 || p.k <= 0 || p.n <= 0) continue;
+            size_t w = zesp ? 2 : 1, mk = (size_t)p.m * p.k * w, kn = (size_t)p.k * p.n * w, mn = (size_t)p.m * p.n * w;
+            float *a = malloc(mk * sizeof(float)), *a2 = malloc(mk * sizeof(float)), *b = malloc(kn * sizeof(float));
+            float *c = malloc((mk > mn ? mk : mn) * sizeof(float)), *c_wz = malloc(mn * sizeof(float));
+            int fd = memfd_create("bench", 0);
+            char nagl[32];
+            int dl = snprintf(nagl, sizeof(nagl), "%d\t%d\n", p.m, p.k);
+            if (a && a2 && b) { losuj_f32(a, mk); losuj_f32(a2, mk); losuj_f32(b, kn); }
+            if (!a || !a2 || !b || !c || !c_wz || fd < 0 || zapisz_wszystko(fd, nagl, (size_t)dl) ||
+                zapisz_tekstowo(fd, zesp ? TYP_COMPLEX : TYP_FLOAT, a, p.m, p.k)) kod = 1;
+            if (!kod) {
+                double tekst = (double)lseek(fd, 0, SEEK_END);
+                double el = (double)w * sizeof(float), flop_mn = (zesp ? 8.0 : 2.0) * p.m * p.k * p.n;
+                snprintf(p.plik, sizeof(p.plik), "/proc/self/fd/%d", fd);
+                p.a = a; p.a2 = a2; p.b = b;
+                p.c = c_wz;
+                przeglad_krok(&p, PR_GEMM);
+                p.c = c;
+                for (size_t z = 0; z < sizeof(zestawy) / sizeof(zestawy[0]); ++z) {
+                    if (ustaw_jadra(zestawy[z])) continue;
+                    przeglad_wynik(&p, "+", "", przeglad_czas(&p, PR_DODAJ), (double)mk, 3.0 * p.m * p.k * el, NAN);
+                    przeglad_wynik(&p, "-", "", przeglad_czas(&p, PR_ODEJMIJ), (double)mk, 3.0 * p.m * p.k * el, NAN);
+                    przeglad_wynik(&p, "^", "", przeglad_czas(&p, PR_TRANSP), 0.0, 2.0 * p.m * p.k * el, NAN);
+                    double t = przeglad_czas(&p, PR_GEMM);
+                    przeglad_wynik(&p, "*", "blokowy", t, flop_mn, 0.0, blad_normowy(c, c_wz, mn));
+                }
+                ustaw_jadra(domyslne);
+                static const int warianty[] = { PR_REF, PR_STRASSEN, PR_PLANY, PR_3M, PR_3M_STRASSEN };
+                static const char *nazwy[] = { "ref", "strassen", "planarny", "3m", "3m+strassen" };
+                for (int v = 0; v < 5; ++v) {
+                    int d = warianty[v];
+                    if (d == PR_REF && (zesp || (double)p.m * p.k * p.n > (double)(1 << 27))) continue;
+                    if (d >= PR_PLANY && !zesp) continue;
+                    double t = przeglad_czas(&p, d);
+                    przeglad_wynik(&p, "*", nazwy[v], t, flop_mn, 0.0, blad_normowy(c, c_wz, mn));
+                }
+                przeglad_wynik(&p, "formatowanie", "", przeglad_czas(&p, PR_FORMAT), 0.0, tekst, NAN);
+                przeglad_wynik(&p, "parsowanie", "", przeglad_czas(&p, PR_PARSOWANIE), 0.0, tekst, NAN);
+            }
+            if (fd >= 0) close(fd);
+            free(a); free(a2); free(b); free(c); free(c_wz);
+        }
+    if (json) printf("\n]}\n");
+    close(p.fd_null);
+    fflush(stdout);
+    return kod;
+}
+
+// --- Opcje wiersza polecen ---
+static struct {
+    int watki;
+    int cichy;                  // --quiet / --no-print: bez wypisywania wyniku na stdout
+    double prog_rzadkosci;      // --sparse-threshold: gestosc, ponizej ktorej tekst trafia do CSR (0 - nigdy)
+    size_t limit_pamieci;       // --mem-limit: budzet pamieci mnozenia w bajtach (0 - bez limitu)
+    int zadania;                // --jobs: rownolegle polecenia w trybie wsadowym (0 - liczba watkow)
+    size_t pamiec_podreczna;    // --cache-size: limit pamieci podrecznej macierzy w trybie wsadowym
+    int strumien;               // --stream: +, - i ^ zawsze strumieniowo (inaczej tylko ponad --mem-limit)
+} opcje = { 0, 0, 0.1, 0, 0, (size_t)1 << 30, 0 };
+
+// Rozmiar w bajtach z opcjonalnym przyrostkiem K/M/G/T.
+static int wczytaj_rozmiar(const char *s, size_t *out) {
+    char *end = NULL;
+    double v = strtod(s, &end), mnoznik = 1.0;
+    if (*end == 'K' || *end == 'k') { mnoznik = 1024.0; end++; }
+    else if (*end == 'M' || *end == 'm') { mnoznik = 1024.0 * 1024; end++; }
+    else if (*end == 'G' || *end == 'g') { mnoznik = 1024.0 * 1024 * 1024; end++; }
+    else if (*end == 'T' || *end == 't') { mnoznik = 1024.0 * 1024 * 1024 * 1024; end++; }
+    if (*end != '\0' || !(v * mnoznik >= 1.0 && v * mnoznik < 1e18)) return 1;
+    *out = (size_t)(v * mnoznik);
+    return 0;
+}
+
+// Zdejmuje z argv rozpoznane opcje "--nazwa [wartosc]"; argumenty pozycyjne zostaja w kolejnosci.
+static int wczytaj_opcje(int *pargc, char **argv) {
+    int n = 1;
+    for (int i = 1; i < *pargc; ++i) {
+        if (strcmp(argv[i], "--threads") == 0) {
+            char *end = NULL;
+            if (i + 1 >= *pargc) { fprintf(stderr, "Brak wartosci opcji %s\n", argv[i]); return 1; }
+            long v = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || v < 1 || v > 4096) { fprintf(stderr, "Nieprawidlowa liczba watkow: %s\n", argv[i]); return 1; }
+            opcje.watki = (int)v;
+        } else if (strcmp(argv[i], "--sparse-threshold") == 0) {
+            char *end = NULL;
+            if (i + 1 >= *pargc) { fprintf(stderr, "Brak wartosci opcji %s\n", argv[i]); return 1; }
+            double v = strtod(argv[++i], &end);
+            if (*end != '\0' || !(v >= 0.0 && v <= 1.0)) { fprintf(stderr, "Nieprawidlowy prog gestosci: %s\n", argv[i]); return 1; }
+            opcje.prog_rzadkosci = v;
+        } else if (strcmp(argv[i], "--strassen") == 0) {
+            char *end = NULL;
+            if (i + 1 >= *pargc) { fprintf(stderr, "Brak wartosci opcji %s\n", argv[i]); return 1; }
+            long v = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || (v != 0 && v < 32) || v > 1000000) { fprintf(stderr, "Nieprawidlowy prog Strassena: %s\n", argv[i]); return 1; }
+            prog_strassena = (int)v;
+        } else if (strcmp(argv[i], "--complex-layout") == 0) {
+            if (i + 1 >= *pargc) { fprintf(stderr, "Brak wartosci opcji %s\n", argv[i]); return 1; }
+            ++i;
+            if (strcmp(argv[i], "planar") == 0) uklad_planarny = 1;
+            else if (strcmp(argv[i], "interleaved") == 0) uklad_planarny = 0;
+            else { fprintf(stderr, "Nieznany uklad liczb zespolonych: %s\n", argv[i]); return 1; }
+        } else if (strcmp(argv[i], "--3m") == 0) {
+            mnozenie_3m = 1;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            opcje.strumien = 1;
+        } else if (strcmp(argv[i], "--precision") == 0) {
+            if (i + 1 >= *pargc) { fprintf(stderr, "Brak wartosci opcji %s\n", argv[i]); return 1; }
+            ++i;
+            if (strcmp(argv[i], "f32") == 0) precyzja = PRECYZJA_F32;
+            else if (strcmp(argv[i], "mixed") == 0) precyzja = PRECYZJA_MIESZANA;
+            else if (strcmp(argv[i], "f64") == 0) precyzja = PRECYZJA_F64;
+            else { fprintf(stderr, "Nieznana precyzja: %s (f32, f64 albo mixed)\n", argv[i]); return 1; }
+        } else if (strcmp(argv[i], "--mem-limit") == 0) {
+            if (i + 1 >= *pargc) { fprintf(stderr, "Brak wartosci opcji %s\n", argv[i]); return 1; }
+            if (wczytaj_rozmiar(argv[++i], &opcje.limit_pamieci)) { fprintf(stderr, "Nieprawidlowy limit pamieci: %s\n", argv[i]); return 1; }
+        } else if (strcmp(argv[i], "--cache-size") == 0) {
+            if (i + 1 >= *pargc) { fprintf(stderr, "Brak wartosci opcji %s\n", argv[i]); return 1; }
+            if (wczytaj_rozmiar(argv[++i], &opcje.pamiec_podreczna)) { fprintf(stderr, "Nieprawidlowy rozmiar pamieci podrecznej: %s\n", argv[i]); return 1; }
+        } else if (strcmp(argv[i], "--jobs") == 0) {
+            char *end = NULL;
+            if (i + 1 >= *pargc) { fprintf(stderr, "Brak wartosci opcji %s\n", argv[i]); return 1; }
+            long v = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || v < 1 || v > 4096) { fprintf(stderr, "Nieprawidlowa liczba polecen: %s\n", argv[i]); return 1; }
+            opcje.zadania = (int)v;
+        } else if (strcmp(argv[i], "--quiet") == 0 || strcmp(argv[i], "--no-print") == 0) {
+            opcje.cichy = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            wlacz_statystyki();
+        } else {
+            argv[n++] = argv[i];
+        }
+    }
+    argv[n] = NULL;
+    *pargc = n;
+    return 0;
+}
+
+// --- Macierze rzadkie (CSR): dzialania ---
+// Zadaniem puli jest pas RZADKA_PAS wierszy wyniku. Algorytmy z wynikiem rzadkim dzialaja w dwoch
+// przebiegach: najpierw liczba elementow w kazdym wierszu, potem wypelnienie po sumie prefiksowej.
+#define RZADKA_PAS 64
+static inline Complex iloczyn_c(Complex a, Complex b) {
+    Complex w = { a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re };
+    return w;
+}
+static long pasy(int rows) { return (rows + RZADKA_PAS - 1) / RZADKA_PAS; }
+static void suma_prefiksowa(long *wiersz, int rows) {
+    for (int i = 0; i < rows; ++i) wiersz[i + 1] += wiersz[i];
+}
+
+// Rzadka x gesta: wiersz C to suma wierszy B skalowanych niezerowymi elementami wiersza A.
+typedef struct { const Rzadka *a; const void *b; int n; void *c; } ZadanieSpmm;
+static void spmm_pas(void *ctx, long t) {
+    ZadanieSpmm *z = ctx;
+    const Rzadka *a = z->a;
+    int i0 = (int)t * RZADKA_PAS, i1 = i0 + RZADKA_PAS < a->rows ? i0 + RZADKA_PAS : a->rows;
+    for (int i = i0; i < i1; ++i) {
+        if (a->zespolona) {
+            Complex *crow = (Complex *)z->c + (size_t)i * z->n;
+            memset(crow, 0, (size_t)z->n * sizeof(Complex));
+            for (long p = a->wiersz[i]; p < a->wiersz[i + 1]; ++p)
+                jadra.caxpy((size_t)z->n, ((const Complex *)a->wart)[p], (const Complex *)z->b + (size_t)a->kol[p] * z->n, crow);
+        } else {
+            float *crow = (float *)z->c + (size_t)i * z->n;
+            memset(crow, 0, (size_t)z->n * sizeof(float));
+            for (long p = a->wiersz[i]; p < a->wiersz[i + 1]; ++p) {
+                float v = ((const float *)a->wart)[p];
+                const float *brow = (const float *)z->b + (size_t)a->kol[p] * z->n;
+                for (int j = 0; j < z->n; ++j) crow[j] += v * brow[j];
+            }
+        }
+    }
+}
+// Gesta x rzadka: C[i,:] += A[i,k] * B[k,:] dla niezerowych A[i,k].
+typedef struct { const void *a; int m, k; const Rzadka *b; void *c; } ZadanieGspm;
+static void gspm_pas(void *ctx, long t) {
+    ZadanieGspm *z = ctx;
+    const Rzadka *b = z->b;
+    int i0 = (int)t * RZADKA_PAS, i1 = i0 + RZADKA_PAS < z->m ? i0 + RZADKA_PAS : z->m;
+    for (int i = i0; i < i1; ++i) {
+        if (b->zespolona) {
+            const Complex *arow = (const Complex *)z->a + (size_t)i * z->k;
+            Complex *crow = (Complex *)z->c + (size_t)i * b->cols;
+            memset(crow, 0, (size_t)b->cols * sizeof(Complex));
+            for (int k = 0; k < z->k; ++k) {
+                if (arow[k].re == 0.0f && arow[k].im == 0.0f) continue;
+                for (long p = b->wiersz[k]; p < b->wiersz[k + 1]; ++p) {
+                    Complex v = iloczyn_c(arow[k], ((const Complex *)b->wart)[p]);
+                    crow[b->kol[p]].re += v.re; crow[b->kol[p]].im += v.im;
+                }
+            }
+        } else {
+            const float *arow = (const float *)z->a + (size_t)i * z->k;
+            float *crow = (float *)z->c + (size_t)i * b->cols;
+            memset(crow, 0, (size_t)b->cols * sizeof(float));
+            for (int k = 0; k < z->k; ++k) {
+                float av = arow[k];
+                if (av == 0.0f) continue;
+                for (long p = b->wiersz[k]; p < b->wiersz[k + 1]; ++p) crow[b->kol[p]] += av * ((const float *)b->wart)[p];
+            }
+        }
+    }
+}
+
+// Rzadka x rzadka (Gustavson): wiersz C zbierany w gestym akumulatorze (SPA) na b->cols kolumn,
+// z lista dotknietych kolumn. Akumulator jest buforem watku; znaczniki po kazdym wierszu wracaja do -1.
+static __thread int *spa_znacznik = NULL, *spa_lista = NULL;
+static __thread Complex *spa_wart = NULL;
+static __thread size_t spa_n = 0;
+static int spa_przygotuj(size_t n) {
+    if (n <= spa_n) return 0;
+    free(spa_znacznik); free(spa_lista); free(spa_wart);
+    spa_znacznik = malloc(n * sizeof(int)); spa_lista = malloc(n * sizeof(int)); spa_wart = malloc(n * sizeof(Complex));
+    if (!spa_znacznik || !spa_lista || !spa_wart) {
+        free(spa_znacznik); free(spa_lista); free(spa_wart);
+        spa_znacznik = spa_lista = NULL; spa_wart = NULL; spa_n = 0;
+        return 1;
+    }
+    for (size_t j = 0; j < n; ++j) spa_znacznik[j] = -1;
+    spa_n = n;
+    return 0;
+}
+static int porownaj_int(const void *x, const void *y) {
+    int a = *(const int *)x, b = *(const int *)y;
+    return (a > b) - (a < b);
+}
+typedef struct { const Rzadka *a, *b; Rzadka *c; int wypelnij, blad; } ZadanieSpgemm;
+static void spgemm_pas(void *ctx, long t) {
+    ZadanieSpgemm *z = ctx;
+    const Rzadka *a = z->a, *b = z->b;
+    Rzadka *c = z->c;
+    if (spa_przygotuj((size_t)b->cols)) { z->blad = 1; return; }
+    float *wf = (float *)spa_wart;
+    int i0 = (int)t * RZADKA_PAS, i1 = i0 + RZADKA_PAS < a->rows ? i0 + RZADKA_PAS : a->rows;
+    for (int i = i0; i < i1; ++i) {
+        int n = 0;
+        for (long p = a->wiersz[i]; p < a->wiersz[i + 1]; ++p) {
+            int k = a->kol[p];
+            for (long q = b->wiersz[k]; q < b->wiersz[k + 1]; ++q) {
+                int j = b->kol[q], nowa = spa_znacznik[j] < 0;
+                if (nowa) { spa_znacznik[j] = 1; spa_lista[n++] = j; }
+                if (!z->wypelnij) continue;
+                if (a->zespolona) {
+                    Complex v = iloczyn_c(((const Complex *)a->wart)[p], ((const Complex *)b->wart)[q]);
+                    if (nowa) { spa_wart[j].re = 0.0f + v.re; spa_wart[j].im = 0.0f + v.im; }
+                    else { spa_wart[j].re += v.re; spa_wart[j].im += v.im; }
+                } else {
+                    float v = ((const float *)a->wart)[p] * ((const float *)b->wart)[q];
+                    wf[j] = (nowa ? 0.0f : wf[j]) + v;     // od +0 jak akumulatory GEMM
+                }
+            }
+        }
+        if (z->wypelnij) {
+            qsort(spa_lista, (size_t)n, sizeof(int), porownaj_int);
+            long d = c->wiersz[i];
+            for (int s = 0; s < n; ++s, ++d) {
+                int j = spa_lista[s];
+                c->kol[d] = j;
+                if (a->zespolona) ((Complex *)c->wart)[d] = spa_wart[j];
+                else ((float *)c->wart)[d] = wf[j];
+            }
+        } else {
+            c->wiersz[i + 1] = n;
+        }
+        for (int s = 0; s < n; ++s) spa_znacznik[spa_lista[s]] = -1;
+    }
+}
+static int rzadka_razy_rzadka(const Rzadka *a, const Rzadka *b, Rzadka *c) {
+    memset(c, 0, sizeof(*c));
+    c->rows = a->rows; c->cols = b->cols; c->zespolona = a->zespolona;
+    c->wiersz = calloc((size_t)a->rows + 1, sizeof(long));
+    if (!c->wiersz) return 4;
+    ZadanieSpgemm z = { a, b, c, 0, 0 };
+    rownolegle(pasy(a->rows), spgemm_pas, &z);
+    suma_prefiksowa(c->wiersz, c->rows);
+    c->nnz = c->wiersz[c->rows];
+    c->kol = malloc((size_t)(c->nnz > 0 ? c->nnz : 1) * sizeof(int));
+    c->wart = malloc((size_t)(c->nnz > 0 ? c->nnz : 1) * rozmiar_el(c->zespolona));
+    if (z.blad || !c->kol || !c->wart) { rzadka_zwolnij(c); return 4; }
+    z.wypelnij = 1;
+    rownolegle(pasy(a->rows), spgemm_pas, &z);
+    if (z.blad) { rzadka_zwolnij(c); return 4; }
+    return 0;
+}
+
+// Rzadka +- rzadka: scalanie posortowanych wierszy. Brakujacy element to +0, wiec a + 0, 0 - b itd.
+// daja dokladnie to samo (lacznie ze znakiem zera) co dzialanie na macierzach gestych.
+static inline float suma_el(float a, float b, int plus) { return plus ? a + b : a - b; }
+typedef struct { const Rzadka *a, *b; Rzadka *c; int plus, wypelnij; } ZadanieSumyRzadkiej;
+static void suma_rzadka_pas(void *ctx, long t) {
+    ZadanieSumyRzadkiej *z = ctx;
+    const Rzadka *a = z->a, *b = z->b;
+    Rzadka *c = z->c;
+    int zesp = a->zespolona;
+    const float *af = a->wart, *bf = b->wart;
+    float *cf = c->wart;
+    int i0 = (int)t * RZADKA_PAS, i1 = i0 + RZADKA_PAS < a->rows ? i0 + RZADKA_PAS : a->rows;
+    for (int i = i0; i < i1; ++i) {
+        long p = a->wiersz[i], pk = a->wiersz[i + 1], q = b->wiersz[i], qk = b->wiersz[i + 1];
+        long d = z->wypelnij ? c->wiersz[i] : 0, n = 0;
+        while (p < pk || q < qk) {
+            int ja = p < pk ? a->kol[p] : INT32_MAX, jb = q < qk ? b->kol[q] : INT32_MAX;
+            if (z->wypelnij) {
+                c->kol[d + n] = ja < jb ? ja : jb;
+                for (int s = 0; s <= zesp; ++s) {
+                    float x = ja <= jb ? af[(zesp + 1) * p + s] : 0.0f, y = jb <= ja ? bf[(zesp + 1) * q + s] : 0.0f;
+                    cf[(zesp + 1) * (d + n) + s] = suma_el(x, y, z->plus);
+                }
+            }
+            if (ja <= jb) p++;
+            if (jb <= ja) q++;
+            n++;
+        }
+        if (!z->wypelnij) c->wiersz[i + 1] = n;
+    }
+}
+static int rzadka_suma(const Rzadka *a, const Rzadka *b, int plus, Rzadka *c) {
+    memset(c, 0, sizeof(*c));
+    c->rows = a->rows; c->cols = a->cols; c->zespolona = a->zespolona;
+    c->wiersz = calloc((size_t)a->rows + 1, sizeof(long));
+    if (!c->wiersz) return 4;
+    ZadanieSumyRzadkiej z = { a, b, c, plus, 0 };
+    rownolegle(pasy(a->rows), suma_rzadka_pas, &z);
+    suma_prefiksowa(c->wiersz, c->rows);
+    c->nnz = c->wiersz[c->rows];
+    c->kol = malloc((size_t)(c->nnz > 0 ? c->nnz : 1) * sizeof(int));
+    c->wart = malloc((size_t)(c->nnz > 0 ? c->nnz : 1) * rozmiar_el(c->zespolona));
+    if (!c->kol || !c->wart) { rzadka_zwolnij(c); return 4; }
+    z.wypelnij = 1;
+    rownolegle(pasy(a->rows), suma_rzadka_pas, &z);
+    return 0;
+}
+// Rzadka +- gesta (w dowolnej kolejnosci) daje gesta: caly wiersz liczony jak z zerem w miejscu
+// brakujacych elementow, potem pozycje niezerowe nadpisane dzialaniem na oryginalnych wartosciach.
+typedef struct { const Rzadka *r; const float *g; int rzadka_pierwsza, plus; float *c; } ZadanieSumyMieszanej;
+static void suma_mieszana_pas(void *ctx, long t) {
+    ZadanieSumyMieszanej *z = ctx;
+    const Rzadka *r = z->r;
+    const float *rf = r->wart;
+    int el = r->zespolona ? 2 : 1;
+    int i0 = (int)t * RZADKA_PAS, i1 = i0 + RZADKA_PAS < r->rows ? i0 + RZADKA_PAS : r->rows;
+    size_t n = (size_t)r->cols * el;      // floatow w wierszu
+    for (int i = i0; i < i1; ++i) {
+        const float *g = z->g + (size_t)i * n;
+        float *c = z->c + (size_t)i * n;
+        if (z->rzadka_pierwsza) for (size_t j = 0; j < n; ++j) c[j] = suma_el(0.0f, g[j], z->plus);
+        else for (size_t j = 0; j < n; ++j) c[j] = suma_el(g[j], 0.0f, z->plus);
+        for (long p = r->wiersz[i]; p < r->wiersz[i + 1]; ++p)
+            for (int s = 0; s < el; ++s) {
+                size_t j = (size_t)r->kol[p] * el + s;
+                float v = rf[(size_t)p * el + s];
+                c[j] = z->rzadka_pierwsza ? suma_el(v, g[j], z->plus) : suma_el(g[j], v, z->plus);
+            }
+    }
+}
+// Gesta rzeczywista +- gesta zespolona (w dowolnej kolejnosci) bez rozszerzania argumentu float. Czesc
+// urojona liczona jak z zerem, wiec wynik jest taki sam jak na rozszerzonej kopii.
+typedef struct { const float *r; const Complex *z; int rzeczywista_pierwsza, plus; Complex *c; size_t n; } ZadanieSumyTypow;
+static void suma_typow_zakres(void *ctx, long i) {
+    ZadanieSumyTypow *z = ctx;
+    size_t lo = (size_t)i * EW_ZAKRES, hi = lo + EW_ZAKRES < z->n ? lo + EW_ZAKRES : z->n;
+    if (z->rzeczywista_pierwsza)
+        for (size_t j = lo; j < hi; ++j) { z->c[j].re = suma_el(z->r[j], z->z[j].re, z->plus); z->c[j].im = suma_el(0.0f, z->z[j].im, z->plus); }
+    else
+        for (size_t j = lo; j < hi; ++j) { z->c[j].re = suma_el(z->z[j].re, z->r[j], z->plus); z->c[j].im = suma_el(z->z[j].im, 0.0f, z->plus); }
+}
+// Transpozycja CSR przez zliczanie po kolumnach; wiersze wyniku wychodza posortowane.
+static int rzadka_transpozycja(const Rzadka *a, Rzadka *t) {
+    if (rzadka_alokuj(t, a->cols, a->rows, a->nnz, a->zespolona)) return 4;
+    long *poz = malloc(((size_t)a->cols + 1) * sizeof(long));
+    if (!poz) { rzadka_zwolnij(t); return 4; }
+    size_t el = rozmiar_el(a->zespolona);
+    for (long p = 0; p < a->nnz; ++p) t->wiersz[a->kol[p] + 1]++;
+    suma_prefiksowa(t->wiersz, t->rows);
+    memcpy(poz, t->wiersz, ((size_t)a->cols + 1) * sizeof(long));
+    for (int i = 0; i < a->rows; ++i)
+        for (long p = a->wiersz[i]; p < a->wiersz[i + 1]; ++p) {
+            long d = poz[a->kol[p]]++;
+            t->kol[d] = i;
+            memcpy((char *)t->wart + (size_t)d * el, (const char *)a->wart + (size_t)p * el, el);
+        }
+    free(poz);
+    return 0;
+}
+
+// Zapis w formacie wejsciowym: naglowek "sparse" i trojki (numeracja od 1). Bloki po rownej liczbie
+// niezerowych formatowane rownolegle i zapisywane po kolei, jak w zapisz_tekstowo.
+typedef struct { const Rzadka *r; long k0, na_blok; BuforWyjscia *bufory; int blad; } ZadanieTrojek;
+static void formatuj_trojki(void *ctx, long b) {
+    ZadanieTrojek *z = ctx;
+    const Rzadka *r = z->r;
+    BuforWyjscia *buf = &z->bufory[b];
+    long k0 = z->k0 + b * z->na_blok, k1 = k0 + z->na_blok < r->nnz ? k0 + z->na_blok : r->nnz;
+    size_t potrzeba = (size_t)(k1 - k0) * (2 * 11 + (r->zespolona ? 2 * MAKS_ZNAKOW_FLOAT + 4 : MAKS_ZNAKOW_FLOAT + 1));
+    buf->dl = 0;
+    if (potrzeba > buf->cap) {
+        char *nb = realloc(buf->dane, potrzeba);
+        if (!nb) { z->blad = 1; return; }
+        buf->dane = nb; buf->cap = potrzeba;
     }
-    return 1;
+    // wiersz elementu k0: ostatni i z wiersz[i] <= k0
+    int lo = 0, hi = r->rows - 1;
+    while (lo < hi) { int m = (lo + hi + 1) / 2; if (r->wiersz[m] <= k0) lo = m; else hi = m - 1; }
+    char *p = buf->dane;
+    for (long k = k0, i = lo; k < k1; ++k) {
+        while (r->wiersz[i + 1] <= k) i++;
+        p += zapisz_uint(p, (unsigned long)i + 1); *p++ = '\t';
+        p += zapisz_uint(p, (unsigned long)r->kol[k] + 1); *p++ = '\t';
+        if (r->zespolona) p += formatuj_complex((const Complex *)r->wart + k, p);
+        else p += formatuj_float(((const float *)r->wart)[k], p);
+        *p++ = '\n';
+    }
+    buf->dl = (size_t)(p - buf->dane);
+}
+static int zapisz_rzadka_tekstowo(int fd, const Rzadka *r) {
+    char nagl[64];
+    int n = snprintf(nagl, sizeof(nagl), "sparse\t%d\t%d\t%ld\n", r->rows, r->cols, r->nnz);
+    if (zapisz_wszystko(fd, nagl, (size_t)n)) return 1;
+    long na_blok = (long)(WYJSCIE_BLOK / (2 * 11 + (r->zespolona ? 2 * MAKS_ZNAKOW_FLOAT + 4 : MAKS_ZNAKOW_FLOAT + 1)));
+    int blokow = 4 * pula.n;
+    ZadanieTrojek z = { r, 0, na_blok, calloc((size_t)blokow, sizeof(BuforWyjscia)), 0 };
+    if (!z.bufory) return 1;
+    int f = faza_wejdz(fd == STDOUT_FILENO ? FAZA_WYPISYWANIE : FAZA_ZAPIS);
+    int wynik = 0;
+    for (long k = 0; k < r->nnz && !wynik; k += na_blok * blokow) {
+        z.k0 = k;
+        long nb = (r->nnz - k + na_blok - 1) / na_blok;
+        if (nb > blokow) nb = blokow;
+        rownolegle(nb, formatuj_trojki, &z);
+        if (z.blad) { wynik = 1; break; }
+        for (long b = 0; b < nb && !wynik; ++b) wynik = zapisz_wszystko(fd, z.bufory[b].dane, z.bufory[b].dl);
+    }
+    for (int b = 0; b < blokow; ++b) free(z.bufory[b].dane);
+    free(z.bufory);
+    faza_wyjdz(f);
+    return wynik;
 }
-static void trim_whitespace(char *s) {
-    char *p = s;
-    while (*p && isspace((unsigned char)*p)) p++;
-    if (p != s) memmove(s, p, strlen(p) + 1);
-    size_t len = strlen(s);
-    while (len > 0 && isspace((unsigned char)s[len - 1])) s[--len] = '\0';
+// .bin nie ma wariantu rzadkiego, wiec zapis binarny rozwija macierz do gestej.
+static int zapisz_rzadka(const char *filename, const Rzadka *r) {
+    int typ = r->zespolona ? TYP_COMPLEX : TYP_FLOAT;
+    if (nazwa_binarna(filename)) {
+        void *g = malloc((size_t)r->rows * r->cols * rozmiar_el(r->zespolona));
+        if (!g) return 1;
+        rzadka_do_gestej(r, g);
+        int wynik = zapisz_binarnie(filename, typ, g, r->rows, r->cols);
+        free(g);
+        return wynik;
+    }
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return 1;
+    int wynik = zapisz_rzadka_tekstowo(fd, r);
+    if (close(fd) != 0) wynik = 1;
+    return wynik;
+}
+// Wypisuje wynik z tytulem (jak main) na fd.
+static void pokaz_wynik(int fd, const char *tytul, const Operand *w, int typ) {
+    fflush(stdout);
+    dprintf(fd, "%s:\n", tytul);
+    if (w->rzadka) zapisz_rzadka_tekstowo(fd, &w->r);
+    else zapisz_tekstowo(fd, typ, w->dane, w->rows, w->cols);
+}
+static int zapisz_wynik(const char *outfile, const Operand *w, int typ) {
+    if (w->rzadka) return zapisz_rzadka(outfile, &w->r);
+    if (typ == TYP_COMPLEX) return save_matrix_complex(outfile, w->dane, w->rows, w->cols);
+    return save_matrix_float(outfile, w->dane, w->rows, w->cols);
+}
+static void wypisz_wynik(const char *tytul, const Operand *w, const char *outfile, int typ) {
+    if (!opcje.cichy) pokaz_wynik(STDOUT_FILENO, tytul, w, typ);
+    if (outfile && zapisz_wynik(outfile, w, typ)) fprintf(stderr, "Blad zapisu %s\n", outfile);
 }
 
-// --- Funkcje dla macierzy rzeczywistych ---
-int wczytaj_macierz(const char *nazwa_pliku, float **pmat, int *prows, int *pcols) {
-    FILE *fp = fopen(nazwa_pliku, "r");
-    if (!fp) { fprintf(stderr, "Nie mozna otworzyc pliku %s\n", nazwa_pliku); return 1; }
-    char line[LINE_BUF_SIZE];
-    int rows = 0, cols = 0, found_size = 0;
-    while (fgets(line, sizeof(line), fp)) {
-        if (is_blank_line(line)) continue;
-        char *p = line, *end;
-        rows = (int)strtol(p, &end, 10);
-        if (end == p) { fclose(fp); return 2; }
-        p = end; while (*p == '\t' || isspace((unsigned char)*p)) p++;
-        cols = (int)strtol(p, &end, 10);
-        if (end == p) { fclose(fp); return 2; }
-        found_size = 1; break;
-    }
-    if (!found_size || rows <= 0 || cols <= 0) { fclose(fp); return 3; }
-    float *mat = malloc((size_t)rows * cols * sizeof(float));
-    if (!mat) { fclose(fp); return 4; }
-    int r = 0;
-    while (r < rows && fgets(line, sizeof(line), fp)) {
-        if (is_blank_line(line)) continue;
-        char *p = line;
-        for (int c = 0; c < cols; ++c) {
-            char *start = p, *end = start;
-            while (*end && *end != '\t' && *end != '\n' && *end != '\r') end++;
-            size_t toklen = (size_t)(end - start);
-            char token[LINE_BUF_SIZE];
-            if (toklen >= sizeof(token)) toklen = sizeof(token) - 1;
-            memcpy(token, start, toklen); token[toklen] = '\0';
-            trim_whitespace(token);
-            if (token[0] == '\0') { free(mat); fclose(fp); return 5; }
-            errno = 0; char *endptr = NULL;
-            float val = strtof(token, &endptr);
-            while (*endptr && isspace((unsigned char)*endptr)) endptr++;
-            if (endptr == token || *endptr != '\0') { free(mat); fclose(fp); return 6; }
-            if (errno == ERANGE) { free(mat); fclose(fp); return 7; }
-            mat[r * cols + c] = val;
-            p = end; if (*p == '\t') p++;
-        }
-        r++;
-    }
-    fclose(fp);
-    if (r < rows) { free(mat); return 8; }
-    *pmat = mat; *prows = rows; *pcols = cols;
+// Dzialanie op na argumentach gestych lub rzadkich; argumenty nie sa modyfikowane. Rzadka +- rzadka
+// i rzadka * rzadka daja wynik rzadki, pozostale kombinacje gesty. Komunikaty jak w sciezce gestej.
+static int oblicz_dzialanie(const char *op, const Operand *a, const Operand *b, Operand *w, const char **tytul) {
+    int zesp = a->zespolona || b->zespolona, mieszane = a->zespolona != b->zespolona;
+    if (mieszane && (a->rzadka || b->rzadka)) {
+        // Jadra CSR sa jednego typu: argument rzeczywisty idzie przez rozszerzona kopie.
+        const Operand *rz = a->zespolona ? b : a;
+        Operand kopia;
+        if (na_zespolony(rz, &kopia)) { fprintf(stderr, "Brak pamieci!\n"); return 1; }
+        int kod = oblicz_dzialanie(op, rz == a ? &kopia : a, rz == b ? &kopia : b, w, tytul);
+        zwolnij_operand(&kopia);
+        return kod;
+    }
+    size_t el = rozmiar_el(zesp);
+    memset(w, 0, sizeof(*w));
+    w->zespolona = zesp;
+    int kod = 0;
+    if (strcmp(op, "+") == 0 || strcmp(op, "-") == 0) {
+        int plus = op[0] == '+';
+        if (a->rows != b->rows || a->cols != b->cols) {
+            fprintf(stderr, plus ? "Nie mozna dodac macierzy o roznych rozmiarach!\n" : "Nie mozna odjac macierzy o roznych rozmiarach!\n");
+            return 1;
+        }
+        *tytul = plus ? "Suma macierzy" : "Roznica macierzy";
+        w->rows = a->rows; w->cols = a->cols;
+        if (a->rzadka && b->rzadka) {
+            w->rzadka = 1;
+            kod = rzadka_suma(&a->r, &b->r, plus, &w->r);
+        } else if ((w->dane = malloc((size_t)w->rows * w->cols * el)) == NULL) kod = 4;
+        else if (a->rzadka || b->rzadka) {
+            ZadanieSumyMieszanej z = { a->rzadka ? &a->r : &b->r, a->rzadka ? b->dane : a->dane, a->rzadka, plus, w->dane };
+            rownolegle(pasy(w->rows), suma_mieszana_pas, &z);
+        } else if (mieszane) {
+            size_t n = (size_t)w->rows * w->cols;
+            dolicz_flop(2.0 * n);
+            ZadanieSumyTypow z = { a->zespolona ? b->dane : a->dane, a->zespolona ? a->dane : b->dane, !a->zespolona, plus, w->dane, n };
+            rownolegle((long)((n + EW_ZAKRES - 1) / EW_ZAKRES), suma_typow_zakres, &z);
+        } else if (zesp) {
+            if (plus) dodaj_macierze_complex(a->dane, b->dane, w->dane, w->rows, w->cols);
+            else odejmij_macierze_complex(a->dane, b->dane, w->dane, w->rows, w->cols);
+        } else {
+            if (plus) dodaj_macierze(a->dane, b->dane, w->dane, w->rows, w->cols);
+            else odejmij_macierze(a->dane, b->dane, w->dane, w->rows, w->cols);
+        }
+    } else if (strcmp(op, "*") == 0) {
+        if (a->cols != b->rows) { fprintf(stderr, "Nie mozna mnozyc: liczba kolumn macierzy 1 musi byc rowna liczbie wierszy macierzy 2!\n"); return 1; }
+        *tytul = "Iloczyn macierzy";
+        w->rows = a->rows; w->cols = b->cols;
+        if (a->rzadka && b->rzadka) {
+            w->rzadka = 1;
+            kod = rzadka_razy_rzadka(&a->r, &b->r, &w->r);
+        } else if ((w->dane = malloc((size_t)w->rows * w->cols * el)) == NULL) kod = 4;
+        else if (a->rzadka) {
+            dolicz_flop((zesp ? 8.0 : 2.0) * a->r.nnz * b->cols);
+            ZadanieSpmm z = { &a->r, b->dane, b->cols, w->dane };
+            rownolegle(pasy(w->rows), spmm_pas, &z);
+        } else if (b->rzadka) {
+            dolicz_flop((zesp ? 8.0 : 2.0) * a->rows * b->r.nnz);
+            ZadanieGspm z = { a->dane, a->rows, a->cols, &b->r, w->dane };
+            rownolegle(pasy(w->rows), gspm_pas, &z);
+        } else if (mieszane) kod = iloczyn_mieszany(a->rows, b->cols, a->cols, a->dane, a->zespolona, b->dane, w->dane);
+        else if (zesp) kod = mnoz_macierze_complex(a->dane, a->rows, a->cols, b->dane, b->rows, b->cols, w->dane);
+        else kod = mnoz_macierze(a->dane, a->rows, a->cols, b->dane, b->rows, b->cols, w->dane);
+    } else {
+        fprintf(stderr, "Nieznana operacja: %s\n", op);
+        return 1;
+    }
+    if (kod) { fprintf(stderr, "Brak pamieci!\n"); zwolnij_operand(w); return 1; }
     return 0;
 }
-void wypisz_macierz(const float *mat, int rows, int cols) {
-    for (int i = 0; i < rows; ++i) {
-        for (int j = 0; j < cols; ++j) {
-            printf("%g", mat[i * cols + j]);
-            if (j + 1 < cols) printf("\t");
-        }
-        printf("\n");
+
+// Dzialanie z main, gdy co najmniej jeden argument jest rzadki albo typy argumentow sie roznia.
+static int dzialanie_operandow(const char *op, const Operand *a, const Operand *b, const char *outfile) {
+    Operand w;
+    const char *tytul;
+    if (oblicz_dzialanie(op, a, b, &w, &tytul)) return 1;
+    wypisz_wynik(tytul, &w, outfile, w.zespolona ? TYP_COMPLEX : TYP_FLOAT);
+    zwolnij_operand(&w);
+    return 0;
+}
+
+// --- Mnozenie poza pamiecia (--mem-limit) ---
+// Gdy A, B i C razem nie mieszcza sie w limicie, A i B sa przepisywane do plikow tymczasowych
+// w ukladzie kafelkowym: kafelki T x T (wierszami, brzegi uzupelnione zerami), A ulozona kolumnami
+// kafelkow, B wierszami kafelkow. Panel A (kafelki I0.. w kolumnie k) i panel B (kafelki J0..
+// w wierszu k) to wtedy jeden ciagly odczyt. Blok C (bm x bn kafelkow) zostaje w pamieci przez
+// cala petle po k, a osobny watek czyta nastepna pare paneli, gdy GEMM liczy biezaca.
+#define POZA_KAFEL_MAX 1024
+#define POZA_KAFEL_MIN 64               // tylko transpozycja; mnozenie schodzi najwyzej do GEMM_KC
+typedef struct {
+    int fd;
+    int rows, cols, t;
+    int kr, kk;                 // kafelki w pionie i w poziomie
+    int kolumnami;              // 1: kolejne kafelki w kolumnie kafelkow sa obok siebie (A)
+    size_t el;
+} Kafelkowa;
+static off_t kafel_poz(const Kafelkowa *k, int i, int j) {
+    long idx = k->kolumnami ? (long)j * k->kr + i : (long)i * k->kk + j;
+    return (off_t)idx * k->t * k->t * (off_t)k->el;
+}
+static int pisz_w(int fd, const void *p, size_t n, off_t poz) {
+    while (n > 0) {
+        ssize_t w = pwrite(fd, p, n, poz);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return 1;
+        dolicz_bajty(&statystyki.zapisane, (size_t)w);
+        p = (const char *)p + w; n -= (size_t)w; poz += w;
     }
+    return 0;
 }
-int dodaj_macierze(const float *a, const float *b, float *wynik, int rows, int cols) {
-    for (int i = 0; i < rows * cols; ++i) wynik[i] = a[i] + b[i];
+static int czytaj_z(int fd, void *p, size_t n, off_t poz) {
+    while (n > 0) {
+        ssize_t r = pread(fd, p, n, poz);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return 1;
+        dolicz_bajty(&statystyki.przeczytane, (size_t)r);
+        p = (char *)p + r; n -= (size_t)r; poz += r;
+    }
     return 0;
 }
-int odejmij_macierze(const float *a, const float *b, float *wynik, int rows, int cols) {
-    for (int i = 0; i < rows * cols; ++i) wynik[i] = a[i] - b[i];
+// Plik tymczasowy zadanego rozmiaru (dziury czytaja sie jako zera), usuniety zaraz po utworzeniu.
+// Katalog z $TMPDIR, domyslnie /var/tmp - /tmp bywa w RAM (tmpfs).
+static int plik_tymczasowy(off_t rozmiar) {
+    const char *kat = getenv("TMPDIR");
+    char sciezka[4096];
+    snprintf(sciezka, sizeof(sciezka), "%s/calc-macierzy-XXXXXX", kat && *kat ? kat : "/var/tmp");
+    int fd = mkstemp(sciezka);
+    if (fd < 0) return -1;
+    unlink(sciezka);
+    if (ftruncate(fd, rozmiar) != 0) { close(fd); return -1; }
+    return fd;
+}
+
+// Otwiera macierz gesta do czytania wierszami; *bin_typ to typ z naglowka binarnego, 0 dla tekstu.
+// Plik rzadki daje -1.
+static int otworz_wiersze(Zrodlo *z, const char *nazwa, int typ, int *bin_typ, int *rows, int *cols) {
+    if (otworz_zrodlo(z, nazwa) != 0) return 1;
+    *bin_typ = 0;
+    if (zrodlo_binarne(z)) {
+        NaglowekBin h;
+        int kod = naglowek_binarny(z, typ, &h);
+        *bin_typ = (int)h.typ; *rows = (int)h.wiersze; *cols = (int)h.kolumny;
+        return kod;
+    }
+    long nnz;
+    int kod = wczytaj_naglowek(z, rows, cols, &nnz);
+    return kod ? kod : nnz >= 0 ? -1 : 0;
+}
+// Kolejne n wierszy do dst (typ docelowy; float z pliku binarnego jest rozszerzany do Complex).
+static int czytaj_wiersze(Zrodlo *z, int bin_typ, int typ, int cols, int n, void *dst) {
+    size_t el = rozmiar_el(typ == TYP_COMPLEX), ile = (size_t)n * cols;
+    if (!bin_typ) {
+        const char *p, *e;
+        for (int w = 0; w < n; ) {
+            if (!nastepna_linia(z, &p, &e)) return 8;
+            if (pusta_linia(p, e)) continue;
+            int kod = parsuj_wiersz(p, e, typ, cols, (char *)dst + (size_t)w * cols * el);
+            if (kod) return kod;
+            w++;
+        }
+        return 0;
+    }
+    if (bin_typ == typ) return zrodlo_czytaj(z, dst, ile * el) == ile * el ? 0 : 8;
+    float *f = (float *)((Complex *)dst + ile) - ile;
+    if (zrodlo_czytaj(z, f, ile * sizeof(float)) != ile * sizeof(float)) return 8;
+    Complex *c = dst;
+    for (size_t i = 0; i < ile; ++i) { float v = f[i]; c[i].re = v; c[i].im = 0.0f; }
     return 0;
 }
-int mnoz_macierze(const float *a, int a_rows, int a_cols, const float *b, int b_rows, int b_cols, float *wynik) {
-    if (a_cols != b_rows) return 1;
-    for (int i = 0; i < a_rows; ++i) {
-        for (int j = 0; j < b_cols; ++j) {
-            float sum = 0.0f;
-            for (int k = 0; k < a_cols; ++k) {
-                sum += a[i * a_cols + k] * b[k * b_cols + j];
+// Przeczytane strony mapowania wejscia nie musza dalej zajmowac pamieci procesu.
+static void oddaj_przeczytane(Zrodlo *z, size_t *zwolnione) {
+    if (!z->dane) return;
+    size_t strona = (size_t)sysconf(_SC_PAGESIZE), gora = z->poz / strona * strona;
+    if (gora > *zwolnione) { madvise((char *)z->dane + *zwolnione, gora - *zwolnione, MADV_DONTNEED); *zwolnione = gora; }
+}
+// Przepisuje macierz ze zrodla do ukladu kafelkowego paczkami wierszy w granicach 'pamiec' bajtow.
+// T jest potega dwojki, wiec paczka (tez potega dwojki, <= T) nie przecina granicy kafelkow
+// i w kazdym kafelku zajmuje jeden ciagly fragment. Kod -1 to blad zapisu.
+static int do_kafelkow(Zrodlo *z, int bin_typ, int typ, const Kafelkowa *k, size_t pamiec) {
+    size_t wiersz_b = (size_t)k->cols * k->el, seg_b = (size_t)k->t * k->el;
+    int r = k->t;
+    while (r > 1 && (size_t)r * (wiersz_b + seg_b) > pamiec) r /= 2;
+    char *buf = malloc((size_t)r * wiersz_b), *seg = malloc((size_t)r * seg_b);
+    int kod = buf && seg ? 0 : 4;
+    size_t zwolnione = 0;
+    for (int w0 = 0; w0 < k->rows && !kod; w0 += r) {
+        int n = k->rows - w0 < r ? k->rows - w0 : r;
+        if ((kod = czytaj_wiersze(z, bin_typ, typ, k->cols, n, buf)) != 0) break;
+        oddaj_przeczytane(z, &zwolnione);
+        for (int j = 0; j < k->kk && !kod; ++j) {
+            int c0 = j * k->t, nc = k->cols - c0 < k->t ? k->cols - c0 : k->t;
+            for (int w = 0; w < n; ++w) {
+                memcpy(seg + w * seg_b, buf + w * wiersz_b + (size_t)c0 * k->el, (size_t)nc * k->el);
+                memset(seg + w * seg_b + (size_t)nc * k->el, 0, (size_t)(k->t - nc) * k->el);
             }
-            wynik[i * b_cols + j] = sum;
+            if (pisz_w(k->fd, seg, (size_t)n * seg_b, kafel_poz(k, w0 / k->t, j) + (off_t)(w0 % k->t) * (off_t)seg_b)) kod = -1;
         }
     }
+    free(buf); free(seg);
+    return kod;
+}
+
+// Odczyt paneli A i B na kolejny krok w osobnym watku.
+typedef struct {
+    int fd[2];
+    off_t poz[2];
+    size_t n[2];
+    void *dst[2];
+    int blad;
+    pthread_t watek;
+} OdczytPaneli;
+static void *czytaj_panele(void *arg) {
+    OdczytPaneli *o = arg;
+    for (int i = 0; i < 2; ++i)
+        if (czytaj_z(o->fd[i], o->dst[i], o->n[i], o->poz[i])) o->blad = 1;
+    return NULL;
+}
+typedef struct {
+    Kafelkowa a, b;
+    int bm, bn, bloki_n;        // blok C w kafelkach i liczba blokow w poziomie
+} PlanPoza;
+// Krok s: blok C (i0, j0 w kafelkach) i kafelek k wymiaru wspolnego.
+static void krok_poza(const PlanPoza *p, long s, int *i0, int *j0, int *k) {
+    *k = (int)(s % p->a.kk);
+    long blok = s / p->a.kk;
+    *i0 = (int)(blok / p->bloki_n) * p->bm;
+    *j0 = (int)(blok % p->bloki_n) * p->bn;
+}
+static int zlec_odczyt(const PlanPoza *p, long s, void *pa, void *pb, OdczytPaneli *o) {
+    int i0, j0, k;
+    krok_poza(p, s, &i0, &j0, &k);
+    size_t kafel_b = (size_t)p->a.t * p->a.t * p->a.el;
+    int mi = p->a.kr - i0 < p->bm ? p->a.kr - i0 : p->bm, nj = p->b.kk - j0 < p->bn ? p->b.kk - j0 : p->bn;
+    *o = (OdczytPaneli){ { p->a.fd, p->b.fd }, { kafel_poz(&p->a, i0, k), kafel_poz(&p->b, k, j0) },
+                         { (size_t)mi * kafel_b, (size_t)nj * kafel_b }, { pa, pb }, 0, 0 };
+    return pthread_create(&o->watek, NULL, czytaj_panele, o);
+}
+
+// Tekst z zmapowanego wyniku pasami wierszy; strony zapisanego pasa sa od razu oddawane.
+static int zapisz_pasami(int fd, int typ, const char *dane, int rows, int cols, int pas) {
+    size_t wiersz_b = (size_t)cols * rozmiar_el(typ == TYP_COMPLEX), strona = (size_t)sysconf(_SC_PAGESIZE);
+    for (int r = 0; r < rows; r += pas) {
+        int n = rows - r < pas ? rows - r : pas;
+        const char *p = dane + (size_t)r * wiersz_b;
+        if (zapisz_tekstowo(fd, typ, p, n, cols)) return 1;
+        const char *od = (const char *)((uintptr_t)p / strona * strona), *doo = p + (size_t)n * wiersz_b;
+        madvise((void *)od, (size_t)(doo - od) / strona * strona, MADV_DONTNEED);
+    }
     return 0;
 }
-void transpose_float(const float *src, float *dst, int rows, int cols) {
-    for (int i = 0; i < rows; ++i)
-        for (int j = 0; j < cols; ++j)
-            dst[j * rows + i] = src[i * cols + j];
+// Mnozenie z main przy --mem-limit. Zwraca -1, gdy wszystko miesci sie w limicie (albo plik jest
+// rzadki) i wystarczy zwykla sciezka; stdin nie da sie przeczytac drugi raz, wiec wtedy zawsze poza pamiecia.
+static int mnozenie_poza_pamiecia(const char *plik_a, const char *plik_b, int typ, const char *outfile) {
+    int zesp = typ == TYP_COMPLEX;
+    size_t el = rozmiar_el(zesp);
+    int strumien = strcmp(plik_a, "-") == 0 || strcmp(plik_b, "-") == 0;
+    Zrodlo za, zb;
+    int bta, btb, m, ka, kb, n;
+    int kod = otworz_wiersze(&za, plik_a, typ, &bta, &m, &ka);
+    if (kod > 0) { fprintf(stderr, "Blad wczytywania %s\n", plik_a); zamknij_zrodlo(&za); return 1; }
+    int kod_b = otworz_wiersze(&zb, plik_b, typ, &btb, &kb, &n);
+    if (kod_b > 0) { fprintf(stderr, "Blad wczytywania %s\n", plik_b); zamknij_zrodlo(&za); zamknij_zrodlo(&zb); return 1; }
+    if (!strumien && (kod < 0 || kod_b < 0 || ((double)m * ka + (double)kb * n + (double)m * n) * el <= (double)opcje.limit_pamieci)) {
+        zamknij_zrodlo(&za); zamknij_zrodlo(&zb);
+        return -1;
+    }
+    if (kod < 0 || kod_b < 0) {
+        fprintf(stderr, "Macierz rzadka ze standardowego wejscia nie jest obslugiwana z --mem-limit\n");
+        zamknij_zrodlo(&za); zamknij_zrodlo(&zb); return 1;
+    }
+    if (ka != kb) {
+        fprintf(stderr, "Nie mozna mnozyc: liczba kolumn macierzy 1 musi byc rowna liczbie wierszy macierzy 2!\n");
+        zamknij_zrodlo(&za); zamknij_zrodlo(&zb); return 1;
+    }
+    // Plan: bufory paczkujace GEMM kazdego watku poza budzetem, potem kafelek T i blok C tak,
+    // zeby C (bm*bn kafelkow) i dwa komplety paneli (2*(bm+bn)) zmiescily sie w reszcie.
+    size_t zapas = (size_t)pula.n * (GEMM_MC * GEMM_KC + GEMM_KC * GEMM_NC) * sizeof(float);
+    size_t budzet = opcje.limit_pamieci > 2 * zapas ? opcje.limit_pamieci - zapas : opcje.limit_pamieci / 2;
+    // T nie mniejsze niz GEMM_KC, zeby granice kafelkow w K byly granicami blokow KC - inaczej
+    // sumowanie po k zmienialoby kolejnosc wzgledem mnozenia w pamieci. Przy bardzo malym limicie
+    // (ponizej 5 kafelkow GEMM_KC x GEMM_KC) budzet jest wiec przekraczany.
+    int t = POZA_KAFEL_MAX;
+    while (t > GEMM_KC && 5 * (size_t)t * t * el > budzet) t /= 2;
+    size_t kafel_b = (size_t)t * t * el;
+    long miejsc = (long)(budzet / kafel_b);
+    PlanPoza p = { { -1, m, ka, t, (m + t - 1) / t, (ka + t - 1) / t, 1, el },
+                   { -1, kb, n, t, (kb + t - 1) / t, (n + t - 1) / t, 0, el }, 1, 1, 0 };
+    for (int zmiana = 1; zmiana; ) {
+        zmiana = 0;
+        if (p.bm < p.a.kr && (long)(p.bm + 1) * p.bn + 2L * (p.bm + 1 + p.bn) <= miejsc) { p.bm++; zmiana = 1; }
+        if (p.bn < p.b.kk && (long)p.bm * (p.bn + 1) + 2L * (p.bm + p.bn + 1) <= miejsc) { p.bn++; zmiana = 1; }
+    }
+    p.bloki_n = (p.b.kk + p.bn - 1) / p.bn;
+
+    int fd_c = -1;
+    off_t dane_c = 0, rozmiar_c = (off_t)m * n * (off_t)el;
+    char *cblk = NULL, *pa[2] = { NULL, NULL }, *pb[2] = { NULL, NULL };
+    p.a.fd = plik_tymczasowy((off_t)p.a.kr * p.a.kk * (off_t)kafel_b);
+    p.b.fd = plik_tymczasowy((off_t)p.b.kr * p.b.kk * (off_t)kafel_b);
+    if (p.a.fd < 0 || p.b.fd < 0) { fprintf(stderr, "Nie mozna utworzyc pliku tymczasowego!\n"); kod = 1; goto koniec; }
+    int faza = faza_wejdz(FAZA_WCZYTYWANIE);
+    for (int i = 0; i < 2 && !kod; ++i) {
+        kod = i ? do_kafelkow(&zb, btb, typ, &p.b, budzet) : do_kafelkow(&za, bta, typ, &p.a, budzet);
+        if (kod < 0) fprintf(stderr, "Blad zapisu pliku tymczasowego!\n");
+        else if (kod) fprintf(stderr, "Blad wczytywania %s\n", i ? plik_b : plik_a);
+    }
+    faza_wyjdz(faza);
+    if (kod) { kod = 1; goto koniec; }
+    dolicz_flop((zesp ? 8.0 : 2.0) * m * ka * n);
+    zamknij_zrodlo(&za); zamknij_zrodlo(&zb);
+
+    // C trafia wprost do pliku .bin albo do pliku tymczasowego, z ktorego powstaje tekst.
+    if (outfile && nazwa_binarna(outfile)) {
+        NaglowekBin h;
+        wypelnij_naglowek(&h, typ, m, n);
+        dane_c = (off_t)h.przesuniecie;
+        fd_c = open(outfile, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_c >= 0 && (pisz_w(fd_c, &h, sizeof(h), 0) || ftruncate(fd_c, dane_c + rozmiar_c) != 0)) { close(fd_c); fd_c = -1; }
+    } else fd_c = plik_tymczasowy(rozmiar_c);
+    if (fd_c < 0) { fprintf(stderr, "Blad zapisu %s\n", outfile ? outfile : "pliku tymczasowego"); kod = 1; goto koniec; }
+
+    cblk = alokuj_wyrownane((size_t)p.bm * p.bn * kafel_b);
+    for (int i = 0; i < 2; ++i) { pa[i] = alokuj_wyrownane((size_t)p.bm * kafel_b); pb[i] = alokuj_wyrownane((size_t)p.bn * kafel_b); }
+    if (!cblk || !pa[0] || !pa[1] || !pb[0] || !pb[1]) { fprintf(stderr, "Brak pamieci!\n"); kod = 1; goto koniec; }
+
+    long krokow = (long)((p.a.kr + p.bm - 1) / p.bm) * p.bloki_n * p.a.kk;
+    long ldc = (long)p.bn * t;
+    OdczytPaneli odczyt[2];
+    if (zlec_odczyt(&p, 0, pa[0], pb[0], &odczyt[0]) != 0) { fprintf(stderr, "Nie mozna uruchomic watku odczytu!\n"); kod = 1; goto koniec; }
+    for (long s = 0; s < krokow && !kod; ++s) {
+        int b = (int)(s & 1);
+        pthread_join(odczyt[b].watek, NULL);
+        if (odczyt[b].blad) { fprintf(stderr, "Blad odczytu pliku tymczasowego!\n"); kod = 1; break; }
+        if (s + 1 < krokow && zlec_odczyt(&p, s + 1, pa[b ^ 1], pb[b ^ 1], &odczyt[b ^ 1]) != 0) {
+            fprintf(stderr, "Nie mozna uruchomic watku odczytu!\n"); kod = 1; break;
+        }
+        int i0, j0, k;
+        krok_poza(&p, s, &i0, &j0, &k);
+        int mr = m - i0 * t < p.bm * t ? m - i0 * t : p.bm * t;
+        int nc = n - j0 * t < p.bn * t ? n - j0 * t : p.bn * t;
+        int kc = ka - k * t < t ? ka - k * t : t;
+        // Kafelki B po kolei; granice kafelkow sa wielokrotnoscia GEMM_KC, wiec sumowanie po k
+        // idzie w tej samej kolejnosci co w pamieci. Galaz skalarna GEMM wybiera pelne n, wiec
+        // waski ostatni kafelek (nj < 4) liczony jest tak samo jak ostatnie kolumny w pamieci.
+        for (int j = 0; j * t < nc && !kod; ++j) {
+            int nj = nc - j * t < t ? nc - j * t : t;
+            if (zesp) {
+                Complex jeden = { 1.0f, 0.0f };
+                kod = gemm_c32(mr, nj, kc, jeden, (Complex *)pa[b], t, 1, (Complex *)(pb[b] + j * kafel_b), t, 1,
+                               k > 0, (Complex *)cblk + (long)j * t, ldc);
+            } else {
+                kod = gemm_f32_pas(mr, nj, kc, 1.0f, (float *)pa[b], t, 1, (float *)(pb[b] + j * kafel_b), t, 1,
+                                   k > 0, (float *)cblk + (long)j * t, ldc, n);
+            }
+            if (kod) fprintf(stderr, "Brak pamieci!\n");
+        }
+        if (!kod && k == p.a.kk - 1)
+            for (int r = 0; r < mr && !kod; ++r)
+                if (pisz_w(fd_c, cblk + (size_t)r * ldc * el, (size_t)nc * el, dane_c + ((off_t)(i0 * t + r) * n + (off_t)j0 * t) * (off_t)el)) {
+                    fprintf(stderr, "Blad zapisu %s\n", outfile && nazwa_binarna(outfile) ? outfile : "pliku tymczasowego");
+                    kod = 1;
+                }
+        if (kod && s + 1 < krokow) pthread_join(odczyt[b ^ 1].watek, NULL);
+    }
+    if (kod) goto koniec;
+    free(cblk); cblk = NULL;
+    for (int i = 0; i < 2; ++i) { free(pa[i]); free(pb[i]); pa[i] = pb[i] = NULL; }
+    malloc_trim(0);             // duze bufory moga zostac w stercie (dynamiczny prog mmap w glibc)
+
+    // Wynik jest na dysku; tekst formatowany z mapowania pliku, strona po stronie.
+    char *mapa = mmap(NULL, (size_t)(dane_c + rozmiar_c), PROT_READ, MAP_SHARED, fd_c, 0);
+    if (mapa == MAP_FAILED) { fprintf(stderr, "Brak pamieci!\n"); kod = 1; goto koniec; }
+    madvise(mapa, (size_t)(dane_c + rozmiar_c), MADV_SEQUENTIAL);
+    int pas = (int)(budzet / 2 / ((size_t)n * el));
+    if (pas < 1) pas = 1;
+    if (!opcje.cichy) {
+        printf("Iloczyn macierzy:\n");
+        fflush(stdout);
+        zapisz_pasami(STDOUT_FILENO, typ, mapa + dane_c, m, n, pas);
+    }
+    if (outfile && !nazwa_binarna(outfile)) {
+        int fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        char nagl[32];
+        int dl = snprintf(nagl, sizeof(nagl), "%d\t%d\n", m, n);
+        int blad = fd < 0 || zapisz_wszystko(fd, nagl, (size_t)dl) || zapisz_pasami(fd, typ, mapa + dane_c, m, n, pas);
+        if ((fd >= 0 && close(fd) != 0) || blad) fprintf(stderr, "Blad zapisu %s\n", outfile);
+    }
+    munmap(mapa, (size_t)(dane_c + rozmiar_c));
+koniec:
+    zamknij_zrodlo(&za); zamknij_zrodlo(&zb);
+    if (p.a.fd >= 0) close(p.a.fd);
+    if (p.b.fd >= 0) close(p.b.fd);
+    if (fd_c >= 0 && close(fd_c) != 0 && !kod && outfile && nazwa_binarna(outfile)) { fprintf(stderr, "Blad zapisu %s\n", outfile); kod = 1; }
+    free(cblk);
+    for (int i = 0; i < 2; ++i) { free(pa[i]); free(pb[i]); }
+    return kod;
 }
-int save_matrix_float(const char *filename, const float *mat, int rows, int cols) {
-    FILE *f = fopen(filename, "w");
-    if (!f) return 1;
-    fprintf(f, "%d\t%d\n", rows, cols);
-    for (int i = 0; i < rows; ++i) {
-        for (int j = 0; j < cols; ++j) {
-            fprintf(f, "%g", mat[i * cols + j]);
-            if (j + 1 < cols) fprintf(f, "\t");
+
+// --- Dzialania strumieniowe (--stream) ---
+// +, - i ^ bez trzymania calych macierzy w pamieci. Suma i roznica: paczki wierszy obu plikow czyta
+// osobny watek, watek glowny liczy, a trzeci wypisuje poprzednia paczke, wiec pamiec zalezy od budzetu
+// (--mem-limit, domyslnie STRUMIEN_PAMIEC), a nie od rozmiaru macierzy. Transpozycja idzie przez plik
+// tymczasowy w ukladzie kafelkowym jak mnozenie poza pamiecia: kolumna kafelkow A to jeden ciagly
+// odczyt, a po transpozycji T pelnych wierszy wyniku.
+#define STRUMIEN_PAMIEC ((size_t)256 << 20)
+
+// Jak czytaj_wiersze, ale tekst wczytywany jako TYP_FLOAT przechodzi na TYP_COMPLEX (*typ) przy
+// pierwszym wierszu z liczba zespolona; wczesniejsze wiersze paczki sa rozszerzane (dst ma miejsce na Complex).
+static int czytaj_wiersze_auto(Zrodlo *z, int bin_typ, int *typ, int cols, int n, void *dst) {
+    if (bin_typ || *typ == TYP_COMPLEX) return czytaj_wiersze(z, bin_typ, *typ, cols, n, dst);
+    const char *p, *e;
+    for (int w = 0; w < n; ) {
+        if (!nastepna_linia(z, &p, &e)) return 8;
+        if (pusta_linia(p, e)) continue;
+        size_t poz = (size_t)w * cols;
+        int kod = parsuj_wiersz(p, e, *typ, cols, *typ == TYP_COMPLEX ? (void *)((Complex *)dst + poz) : (void *)((float *)dst + poz));
+        if (kod == 6 && *typ == TYP_FLOAT && memchr(p, 'i', (size_t)(e - p))) {
+            rozszerz_w_miejscu(dst, poz);
+            *typ = TYP_COMPLEX;
+            kod = parsuj_wiersz(p, e, TYP_COMPLEX, cols, (Complex *)dst + poz);
         }
-        fprintf(f, "\n");
+        if (kod) return kod;
+        w++;
     }
-    fclose(f);
     return 0;
 }
 
-// --- Funkcje dla macierzy zespolonych ---
-int parse_complex(const char *str, Complex *out) {
-    char s[LINE_BUF_SIZE];
-    strncpy(s, str, sizeof(s) - 1);
-    s[sizeof(s) - 1] = '\0';
-    trim_whitespace(s);
-    char t[LINE_BUF_SIZE];
-    int ti = 0;
-    for (int i = 0; s[i] && ti + 1 < (int)sizeof(t); ++i) {
-        if (s[i] == '*') continue;
-        t[ti++] = s[i];
-    }
-    t[ti] = '\0';
-    char *i_ptr = strchr(t, 'i');
-    if (!i_ptr) {
-        if (sscanf(t, "%f", &out->re) == 1) {
-            out->im = 0.0f;
+typedef struct {
+    Zrodlo z[2];
+    int bin_typ[2], typ[2];     // typ: TYP_COMPLEX od pierwszej liczby zespolonej w pliku
+    int cols;
+    size_t zwolnione[2];
+} WejscieStrumienia;
+typedef struct {
+    WejscieStrumienia *we;
+    int n;
+    void *dst[2];
+    int typ[2], kod, plik;      // typy wczytanej paczki; plik - ktory dal blad
+    pthread_t watek;
+} OdczytPaczki;
+static void *czytaj_paczke(void *arg) {
+    OdczytPaczki *o = arg;
+    for (int i = 0; i < 2 && !o->kod; ++i) {
+        o->kod = czytaj_wiersze_auto(&o->we->z[i], o->we->bin_typ[i], &o->we->typ[i], o->we->cols, o->n, o->dst[i]);
+        o->typ[i] = o->we->typ[i];
+        o->plik = i;
+        oddaj_przeczytane(&o->we->z[i], &o->we->zwolnione[i]);
+    }
+    return NULL;
+}
+// Paczka wyniku na stdout (bez --quiet) i do pliku (fd >= 0; bin - surowe dane, inaczej tekst).
+typedef struct {
+    int typ, rows, cols, fd, bin;
+    const void *dane;
+    int blad;
+    pthread_t watek;
+} ZapisPaczki;
+static void *zapisz_paczke(void *arg) {
+    ZapisPaczki *z = arg;
+    if (!opcje.cichy) zapisz_tekstowo(STDOUT_FILENO, z->typ, z->dane, z->rows, z->cols);
+    if (z->fd >= 0) {
+        if (z->bin) z->blad = zapisz_wszystko(z->fd, z->dane, (size_t)z->rows * z->cols * rozmiar_el(z->typ == TYP_COMPLEX));
+        else z->blad = zapisz_tekstowo(z->fd, z->typ, z->dane, z->rows, z->cols);
+    }
+    return NULL;
+}
+// Tytul na stdout i plik wyniku z naglowkiem (tekst "wiersze<TAB>kolumny" albo naglowek .bin); -1 przy bledzie.
+static int otworz_wynik_strumienia(const char *tytul, const char *outfile, int typ, int rows, int cols) {
+    if (!opcje.cichy) { printf("%s:\n", tytul); fflush(stdout); }
+    if (!outfile) return -1;
+    int fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    int blad;
+    if (nazwa_binarna(outfile)) {
+        NaglowekBin h;
+        wypelnij_naglowek(&h, typ, rows, cols);
+        blad = zapisz_wszystko(fd, (const char *)&h, sizeof(h));
+    } else {
+        char nagl[32];
+        int n = snprintf(nagl, sizeof(nagl), "%d\t%d\n", rows, cols);
+        blad = zapisz_wszystko(fd, nagl, (size_t)n);
+    }
+    if (blad) { close(fd); return -1; }
+    return fd;
+}
+
+// Suma albo roznica z main przy --stream lub --mem-limit. Zwraca -1, gdy bez --stream wszystko miesci
+// sie w limicie (albo argument jest rzadki) i wystarczy zwykla sciezka; stdin nie da sie przeczytac
+// drugi raz, wiec wtedy zawsze strumieniowo.
+static int suma_strumieniowa(const char *plik_a, const char *op, const char *plik_b, const char *outfile) {
+    int plus = strcmp(op, "+") == 0;
+    const char *nazwy[2] = { plik_a, plik_b };
+    WejscieStrumienia we;
+    memset(&we, 0, sizeof(we));
+    int rows[2], cols[2], kod[2] = { 0, 0 };
+    for (int i = 0; i < 2; ++i) {
+        kod[i] = otworz_wiersze(&we.z[i], nazwy[i], TYP_COMPLEX, &we.bin_typ[i], &rows[i], &cols[i]);
+        if (kod[i] > 0) {
+            fprintf(stderr, "Blad wczytywania %s\n", nazwy[i]);
+            for (int j = 0; j <= i; ++j) zamknij_zrodlo(&we.z[j]);
             return 1;
         }
-        return 0;
+        we.typ[i] = we.bin_typ[i] == TYP_COMPLEX ? TYP_COMPLEX : TYP_FLOAT;
     }
-    *i_ptr = '\0';
-    trim_whitespace(t);
-    if (t[0] == '\0') { out->re = 0.0f; out->im = 1.0f; return 1; }
-    char *sep = NULL;
-    for (char *p = t + 1; *p; ++p) if (*p == '+' || *p == '-') sep = p;
-    if (sep) {
-        char realpart[LINE_BUF_SIZE];
-        size_t rlen = (size_t)(sep - t);
-        if (rlen >= sizeof(realpart)) rlen = sizeof(realpart) - 1;
-        memcpy(realpart, t, rlen);
-        realpart[rlen] = '\0';
-        trim_whitespace(realpart);
-        char imagpart[LINE_BUF_SIZE];
-        strncpy(imagpart, sep + 1, sizeof(imagpart) - 1);
-        imagpart[sizeof(imagpart) - 1] = '\0';
-        trim_whitespace(imagpart);
-        if (realpart[0] == '\0') out->re = 0.0f;
-        else if (sscanf(realpart, "%f", &out->re) != 1) return 0;
-        float imv;
-        if (imagpart[0] == '\0') imv = 1.0f; else if (sscanf(imagpart, "%f", &imv) != 1) return 0;
-        if (*sep == '-') imv = -imv;
-        out->im = imv;
-        return 1;
+    int ze_stdin = strcmp(plik_a, "-") == 0 || strcmp(plik_b, "-") == 0;
+    double potrzeba = 3.0 * rows[0] * cols[0] * rozmiar_el(we.typ[0] == TYP_COMPLEX || we.typ[1] == TYP_COMPLEX);
+    if (!ze_stdin && (kod[0] < 0 || kod[1] < 0 || (!opcje.strumien && potrzeba <= (double)opcje.limit_pamieci))) {
+        zamknij_zrodlo(&we.z[0]); zamknij_zrodlo(&we.z[1]);
+        return -1;
     }
-    float imv;
-    if (sscanf(t, "%f", &imv) == 1) {
-        out->re = 0.0f; out->im = imv; return 1;
+    int wynik = 0;
+    if (kod[0] < 0 || kod[1] < 0) {
+        fprintf(stderr, "Macierz rzadka ze standardowego wejscia nie jest obslugiwana strumieniowo\n");
+        wynik = 1;
+    } else if (rows[0] != rows[1] || cols[0] != cols[1]) {
+        fprintf(stderr, plus ? "Nie mozna dodac macierzy o roznych rozmiarach!\n" : "Nie mozna odjac macierzy o roznych rozmiarach!\n");
+        wynik = 1;
     }
-    if (t[0] == '-') imv = -1.0f; else imv = 1.0f;
-    out->re = 0.0f; out->im = imv;
-    return 1;
+    if (wynik) { zamknij_zrodlo(&we.z[0]); zamknij_zrodlo(&we.z[1]); return 1; }
+    int m = rows[0], n = cols[0];
+    we.cols = n;
+    // Naglowek .bin powstaje przed pierwsza paczka, wiec typ wyniku trzeba znac z gory.
+    int bin = outfile && nazwa_binarna(outfile);
+    int typ_bin = (we.typ[0] == TYP_COMPLEX || we.typ[1] == TYP_COMPLEX
+                   || (bin && ((!we.bin_typ[0] && plik_zespolony(plik_a)) || (!we.bin_typ[1] && plik_zespolony(plik_b))))) ? TYP_COMPLEX : TYP_FLOAT;
+
+    // Bufory po Complex (paczka moze przejsc na zespolone): 2 x (A, B) do odczytu i 2 wyniki.
+    size_t budzet = opcje.limit_pamieci ? opcje.limit_pamieci : STRUMIEN_PAMIEC;
+    size_t wiersz_b = (size_t)n * sizeof(Complex);
+    int r = (int)(budzet / (6 * wiersz_b) < (size_t)m ? budzet / (6 * wiersz_b) : (size_t)m);
+    if (r < 1) r = 1;
+    void *wejscie[2][2] = { { NULL, NULL }, { NULL, NULL } }, *wyjscie[2] = { NULL, NULL };
+    for (int b = 0; b < 2; ++b) {
+        wejscie[b][0] = alokuj_wyrownane((size_t)r * wiersz_b);
+        wejscie[b][1] = alokuj_wyrownane((size_t)r * wiersz_b);
+        wyjscie[b] = alokuj_wyrownane((size_t)r * wiersz_b);
+    }
+    OdczytPaczki odczyt[2];
+    ZapisPaczki zapis[2];
+    int czyta[2] = { 0, 0 }, pisze[2] = { 0, 0 };
+    int fd = -1;
+    if (!wejscie[0][0] || !wejscie[0][1] || !wejscie[1][0] || !wejscie[1][1] || !wyjscie[0] || !wyjscie[1]) {
+        fprintf(stderr, "Brak pamieci!\n"); wynik = 1; goto koniec;
+    }
+    fd = otworz_wynik_strumienia(plus ? "Suma macierzy" : "Roznica macierzy", outfile, typ_bin, m, n);
+    if (outfile && fd < 0) { fprintf(stderr, "Blad zapisu %s\n", outfile); wynik = 1; goto koniec; }
+
+    long paczek = (m + r - 1) / r;
+    for (long s = 0; s < paczek + 1 && !wynik; ++s) {
+        int b = (int)(s & 1);
+        // Odczyt paczki s + 1 rusza, zanim watek glowny zacznie liczyc paczke s.
+        if (s > 0) {
+            pthread_join(odczyt[b ^ 1].watek, NULL);
+            czyta[b ^ 1] = 0;
+            if (odczyt[b ^ 1].kod) { fprintf(stderr, "Blad wczytywania %s\n", nazwy[odczyt[b ^ 1].plik]); wynik = 1; break; }
+        }
+        if (s < paczek) {
+            int w0 = (int)s * r;
+            odczyt[b] = (OdczytPaczki){ &we, m - w0 < r ? m - w0 : r, { wejscie[b][0], wejscie[b][1] }, { 0, 0 }, 0, 0, 0 };
+            if (pthread_create(&odczyt[b].watek, NULL, czytaj_paczke, &odczyt[b]) != 0) {
+                fprintf(stderr, "Nie mozna uruchomic watku odczytu!\n"); wynik = 1; break;
+            }
+            czyta[b] = 1;
+        }
+        if (s == 0) continue;
+        OdczytPaczki *o = &odczyt[b ^ 1];
+        int typ = o->typ[0] == TYP_COMPLEX || o->typ[1] == TYP_COMPLEX || typ_bin == TYP_COMPLEX ? TYP_COMPLEX : TYP_FLOAT;
+        if (bin && typ != typ_bin) {
+            fprintf(stderr, "Blad zapisu %s: liczby zespolone po zapisaniu czesci wyniku jako float\n", outfile);
+            wynik = 1; break;
+        }
+        for (int i = 0; i < 2; ++i)
+            if (typ == TYP_COMPLEX && o->typ[i] != TYP_COMPLEX) rozszerz_w_miejscu(o->dst[i], (size_t)o->n * n);
+        void *c = wyjscie[b ^ 1];
+        if (typ == TYP_COMPLEX) (plus ? dodaj_macierze_complex : odejmij_macierze_complex)(o->dst[0], o->dst[1], c, o->n, n);
+        else (plus ? dodaj_macierze : odejmij_macierze)(o->dst[0], o->dst[1], c, o->n, n);
+        // Bufor wyniku b ^ 1 zwolnil zapis paczki s - 2; zapisy ida po kolei.
+        if (pisze[b]) {
+            pthread_join(zapis[b].watek, NULL);
+            pisze[b] = 0;
+            if (zapis[b].blad) { fprintf(stderr, "Blad zapisu %s\n", outfile); wynik = 1; break; }
+        }
+        zapis[b ^ 1] = (ZapisPaczki){ typ, o->n, n, fd, bin, c, 0, 0 };
+        if (pthread_create(&zapis[b ^ 1].watek, NULL, zapisz_paczke, &zapis[b ^ 1]) != 0) {
+            fprintf(stderr, "Nie mozna uruchomic watku zapisu!\n"); wynik = 1; break;
+        }
+        pisze[b ^ 1] = 1;
+    }
+koniec:
+    for (int b = 0; b < 2; ++b) if (czyta[b]) pthread_join(odczyt[b].watek, NULL);
+    for (int b = 0; b < 2; ++b)
+        if (pisze[b]) {
+            pthread_join(zapis[b].watek, NULL);
+            if (zapis[b].blad && !wynik) { fprintf(stderr, "Blad zapisu %s\n", outfile); wynik = 1; }
+        }
+    if (fd >= 0 && close(fd) != 0 && !wynik) { fprintf(stderr, "Blad zapisu %s\n", outfile); wynik = 1; }
+    zamknij_zrodlo(&we.z[0]); zamknij_zrodlo(&we.z[1]);
+    for (int b = 0; b < 2; ++b) { free(wejscie[b][0]); free(wejscie[b][1]); free(wyjscie[b]); }
+    return wynik;
 }
-int wczytaj_macierz_complex(const char *nazwa_pliku, Complex **pmat, int *prows, int *pcols) {
-    FILE *fp = fopen(nazwa_pliku, "r");
-    if (!fp) { fprintf(stderr, "Nie mozna otworzyc pliku %s\n", nazwa_pliku); return 1; }
-    char line[LINE_BUF_SIZE];
-    int rows = 0, cols = 0, found_size = 0;
-    while (fgets(line, sizeof(line), fp)) {
-        if (is_blank_line(line)) continue;
-        char *p = line, *end;
-        rows = (int)strtol(p, &end, 10);
-        if (end == p) { fclose(fp); return 2; }
-        p = end; while (*p == '\t' || isspace((unsigned char)*p)) p++;
-        cols = (int)strtol(p, &end, 10);
-        if (end == p) { fclose(fp); return 2; }
-        found_size = 1; break;
-    }
-    if (!found_size || rows <= 0 || cols <= 0) { fclose(fp); return 3; }
-    Complex *mat = malloc((size_t)rows * cols * sizeof(Complex));
-    if (!mat) { fclose(fp); return 4; }
-    int r = 0;
-    while (r < rows && fgets(line, sizeof(line), fp)) {
-        if (is_blank_line(line)) continue;
-        char *p = line;
-        for (int c = 0; c < cols; ++c) {
-            char *start = p, *end = start;
-            while (*end && *end != '\t' && *end != '\n' && *end != '\r') end++;
-            size_t toklen = (size_t)(end - start);
-            char token[LINE_BUF_SIZE];
-            if (toklen >= sizeof(token)) toklen = sizeof(token) - 1;
-            memcpy(token, start, toklen); token[toklen] = '\0';
-            trim_whitespace(token);
-            if (token[0] == '\0') { free(mat); fclose(fp); return 5; }
-            Complex val;
-            if (!parse_complex(token, &val)) { free(mat); fclose(fp); return 6; }
-            mat[r * cols + c] = val;
-            p = end; if (*p == '\t') p++;
-        }
-        r++;
-    }
-    fclose(fp);
-    if (r < rows) { free(mat); return 8; }
-    *pmat = mat; *prows = rows; *pcols = cols;
-    return 0;
-}
-static void format_complex_to_buf(const Complex *z, char *buf, size_t n) {
-    int re_int = (int)z->re;
-    int im_int = (int)z->im;
-    int has_re = (z->re > 1e-6 || z->re < -1e-6);
-    int has_im = (z->im > 1e-6 || z->im < -1e-6);
-    if (has_re && has_im) {
-        if (z->im > 0)
-            snprintf(buf, n, "%d+%d*i", re_int, im_int);
-        else
-            snprintf(buf, n, "%d%d*i", re_int, im_int);
-    } else if (has_im) {
-        snprintf(buf, n, "%d*i", im_int);
-    } else {
-        snprintf(buf, n, "%d", re_int);
+
+// Transpozycja z main przy --stream lub --mem-limit; zwraca -1 jak suma_strumieniowa. Kafelki maja
+// staly rozmiar elementu, wiec typ tekstu wykrywany jest z gory (plik_zespolony); stdin nie da sie
+// przejrzec, wiec idzie jako Complex (tekst wyniku jest ten sam, .bin zapisuje sie jako Complex).
+static int transpozycja_strumieniowa(const char *infile, const char *outfile) {
+    Zrodlo z;
+    int bt, m, n;
+    int kod = otworz_wiersze(&z, infile, TYP_COMPLEX, &bt, &m, &n);
+    if (kod > 0) { fprintf(stderr, "Blad wczytywania %s\n", infile); zamknij_zrodlo(&z); return 1; }
+    int ze_stdin = strcmp(infile, "-") == 0;
+    if (!ze_stdin && (kod < 0 || (!opcje.strumien && (double)m * n * rozmiar_el(bt == TYP_COMPLEX) <= (double)opcje.limit_pamieci))) {
+        zamknij_zrodlo(&z);
+        return -1;
+    }
+    if (kod < 0) {
+        fprintf(stderr, "Macierz rzadka ze standardowego wejscia nie jest obslugiwana strumieniowo\n");
+        zamknij_zrodlo(&z); return 1;
+    }
+    int typ = bt ? bt : ze_stdin || plik_zespolony(infile) ? TYP_COMPLEX : TYP_FLOAT;
+    size_t el = rozmiar_el(typ == TYP_COMPLEX);
+    // Dwa panele (kolumny kafelkow) i dwa bloki wyniku po T x m elementow.
+    size_t budzet = opcje.limit_pamieci ? opcje.limit_pamieci : STRUMIEN_PAMIEC;
+    int t = POZA_KAFEL_MAX;
+    while (t > POZA_KAFEL_MIN && 4.0 * ((double)(m + t - 1) / t * t) * t * el > (double)budzet) t /= 2;
+    Kafelkowa k = { -1, m, n, t, (m + t - 1) / t, (n + t - 1) / t, 1, el };
+    size_t panel_b = (size_t)k.kr * t * t * el, blok_b = (size_t)t * m * el;
+    char *panel[2] = { NULL, NULL }, *blok[2] = { NULL, NULL };
+    OdczytPaneli odczyt[2];
+    ZapisPaczki zapis[2];
+    int czyta[2] = { 0, 0 }, pisze[2] = { 0, 0 }, fd = -1, wynik = 0;
+    k.fd = plik_tymczasowy((off_t)k.kr * k.kk * t * t * (off_t)el);
+    if (k.fd < 0) { fprintf(stderr, "Nie mozna utworzyc pliku tymczasowego!\n"); wynik = 1; goto koniec; }
+    int faza = faza_wejdz(FAZA_WCZYTYWANIE);
+    kod = do_kafelkow(&z, bt, typ, &k, budzet);
+    faza_wyjdz(faza);
+    if (kod) {
+        if (kod < 0) fprintf(stderr, "Blad zapisu pliku tymczasowego!\n");
+        else fprintf(stderr, "Blad wczytywania %s\n", infile);
+        wynik = 1; goto koniec;
+    }
+    zamknij_zrodlo(&z);
+    malloc_trim(0);
+    for (int b = 0; b < 2; ++b) { panel[b] = alokuj_wyrownane(panel_b); blok[b] = alokuj_wyrownane(blok_b); }
+    if (!panel[0] || !panel[1] || !blok[0] || !blok[1]) { fprintf(stderr, "Brak pamieci!\n"); wynik = 1; goto koniec; }
+    fd = otworz_wynik_strumienia("Transpozycja macierzy", outfile, typ, n, m);
+    if (outfile && fd < 0) { fprintf(stderr, "Blad zapisu %s\n", outfile); wynik = 1; goto koniec; }
+
+    for (int j = 0; j < k.kk + 1 && !wynik; ++j) {
+        int b = j & 1;
+        if (j > 0) {
+            pthread_join(odczyt[b ^ 1].watek, NULL);
+            czyta[b ^ 1] = 0;
+            if (odczyt[b ^ 1].blad) { fprintf(stderr, "Blad odczytu pliku tymczasowego!\n"); wynik = 1; break; }
+        }
+        if (j < k.kk) {
+            odczyt[b] = (OdczytPaneli){ { k.fd, k.fd }, { kafel_poz(&k, 0, j), 0 }, { panel_b, 0 }, { panel[b], NULL }, 0, 0 };
+            if (pthread_create(&odczyt[b].watek, NULL, czytaj_panele, &odczyt[b]) != 0) {
+                fprintf(stderr, "Nie mozna uruchomic watku odczytu!\n"); wynik = 1; break;
+            }
+            czyta[b] = 1;
+        }
+        if (j == 0) continue;
+        // Panel to kolumna kafelkow ulozonych jeden pod drugim: macierz (kr*T) x T o wierszach
+        // dlugosci T, wiec jej pierwsze m wierszy transponuje sie jak zwykla macierz m x T.
+        int c0 = (j - 1) * t, nc = n - c0 < t ? n - c0 : t;
+        transpozycja(panel[b ^ 1], blok[b ^ 1], m, t, typ == TYP_COMPLEX);
+        if (pisze[b]) {
+            pthread_join(zapis[b].watek, NULL);
+            pisze[b] = 0;
+            if (zapis[b].blad) { fprintf(stderr, "Blad zapisu %s\n", outfile); wynik = 1; break; }
+        }
+        zapis[b ^ 1] = (ZapisPaczki){ typ, nc, m, fd, outfile && nazwa_binarna(outfile), blok[b ^ 1], 0, 0 };
+        if (pthread_create(&zapis[b ^ 1].watek, NULL, zapisz_paczke, &zapis[b ^ 1]) != 0) {
+            fprintf(stderr, "Nie mozna uruchomic watku zapisu!\n"); wynik = 1; break;
+        }
+        pisze[b ^ 1] = 1;
     }
+koniec:
+    for (int b = 0; b < 2; ++b) if (czyta[b]) pthread_join(odczyt[b].watek, NULL);
+    for (int b = 0; b < 2; ++b)
+        if (pisze[b]) {
+            pthread_join(zapis[b].watek, NULL);
+            if (zapis[b].blad && !wynik) { fprintf(stderr, "Blad zapisu %s\n", outfile); wynik = 1; }
+        }
+    if (fd >= 0 && close(fd) != 0 && !wynik) { fprintf(stderr, "Blad zapisu %s\n", outfile); wynik = 1; }
+    zamknij_zrodlo(&z);
+    if (k.fd >= 0) close(k.fd);
+    for (int b = 0; b < 2; ++b) { free(panel[b]); free(blok[b]); }
+    return wynik;
 }
-void wypisz_macierz_complex(const Complex *mat, int rows, int cols) {
-    char buf[64];
-    for (int i = 0; i < rows; ++i) {
-        for (int j = 0; j < cols; ++j) {
-            format_complex_to_buf(&mat[i * cols + j], buf, sizeof(buf));
-            printf("%s", buf);
-            if (j + 1 < cols) printf("\t");
+
+// --- Podwojna precyzja (--precision f64) ---
+// Argumenty sa geste, w double albo ComplexD (Operand.zespolona), a tekst parsowany jest wprost
+// do double. Plik binarny (float) jest rozszerzany, plik rzadki rozwijany do gestej; CSR, Strassen
+// i 3M dzialaja tylko we float, wiec tu ich nie ma. Wynik .bin zapisywany jest jako float.
+
+// Jak rozszerz_na_complex, dla double -> ComplexD.
+static void *rozszerz_na_complex_d(void *dane, size_t n, size_t pojemnosc) {
+    ComplexD *c = realloc(dane, (pojemnosc ? pojemnosc : 1) * sizeof(ComplexD));
+    if (!c) return NULL;
+    const double *d = (const double *)c;
+    for (size_t i = n; i-- > 0;) { double v = d[i]; c[i].re = v; c[i].im = 0.0; }
+    return c;
+}
+// Trojki "i j v" wprost do gestej; powtorzenia sumowane w kolejnosci pliku, jak w wczytaj_trojki.
+static int trojki_f64(Zrodlo *z, Operand *o, long nnz) {
+    size_t n = (size_t)o->rows * o->cols;
+    double *d = calloc(n ? n : 1, sizeof(double));
+    int kod = d ? 0 : 4;
+    long k = 0;
+    const char *s, *e;
+    while (!kod && k < nnz && nastepna_linia(z, &s, &e)) {
+        if (pusta_linia(s, e)) continue;
+        int i, j;
+        const char *p = parsuj_int(s, e, &i), *q = p == s ? p : parsuj_int(p, e, &j);
+        if (p == s || q == p) { kod = 2; break; }
+        if (i < 1 || i > o->rows || j < 1 || j > o->cols) { kod = BLAD_INDEKSU; break; }
+        while (q < e && bialy_znak(*q)) q++;
+        size_t idx = (size_t)(i - 1) * o->cols + (size_t)(j - 1);
+        double v = 0.0;
+        ComplexD c = { 0.0, 0.0 };
+        if (!o->zespolona) token_double(q, e, &v, &kod);
+        if (kod == 6 && memchr(q, 'i', (size_t)(e - q))) {
+            double *nd = rozszerz_na_complex_d(d, n, n);
+            if (!nd) { kod = 4; break; }
+            d = nd; o->zespolona = 1; kod = 0;
         }
-        printf("\n");
+        if (o->zespolona) token_complex_d(q, e, &c, &kod);
+        if (kod) break;
+        if (o->zespolona) { ((ComplexD *)d)[idx].re += c.re; ((ComplexD *)d)[idx].im += c.im; }
+        else d[idx] += v;
+        k++;
     }
+    if (!kod && k < nnz) kod = 8;
+    o->dane = d;
+    return kod;
 }
-int save_matrix_complex(const char *filename, const Complex *mat, int rows, int cols) {
-    FILE *f = fopen(filename, "w");
-    if (!f) return 1;
-    fprintf(f, "%d\t%d\n", rows, cols);
-    char buf[64];
-    for (int i = 0; i < rows; ++i) {
-        for (int j = 0; j < cols; ++j) {
-            format_complex_to_buf(&mat[i * cols + j], buf, sizeof(buf));
-            fprintf(f, "%s", buf);
-            if (j + 1 < cols) fprintf(f, "\t");
+static int gesty_f64(Zrodlo *z, Operand *o) {
+    size_t n = (size_t)o->rows * o->cols;
+    double *d = malloc(n * sizeof(double));
+    int kod = d ? 0 : 4, w = 0;
+    const char *p, *e;
+    while (!kod && w < o->rows && nastepna_linia(z, &p, &e)) {
+        if (pusta_linia(p, e)) continue;
+        size_t poz = (size_t)w * o->cols;
+        kod = parsuj_wiersz(p, e, o->zespolona ? TYP_C64 : TYP_F64, o->cols, o->zespolona ? (void *)((ComplexD *)d + poz) : (void *)(d + poz));
+        if (kod == 6 && !o->zespolona && memchr(p, 'i', (size_t)(e - p))) {
+            double *nd = rozszerz_na_complex_d(d, poz, n);
+            if (!nd) { kod = 4; break; }
+            d = nd; o->zespolona = 1;
+            kod = parsuj_wiersz(p, e, TYP_C64, o->cols, (ComplexD *)d + poz);
+        }
+        if (!kod) w++;
+    }
+    if (!kod && w < o->rows) kod = 8;
+    o->dane = d;
+    return kod;
+}
+static int wczytaj_f64(const char *nazwa_pliku, Operand *o) {
+    memset(o, 0, sizeof(*o));
+    Zrodlo z;
+    if (otworz_zrodlo(&z, nazwa_pliku) != 0) { fprintf(stderr, "Nie mozna otworzyc pliku %s\n", nazwa_pliku); return 1; }
+    int f = faza_wejdz(FAZA_WCZYTYWANIE), kod;
+    if (zrodlo_binarne(&z)) {
+        int typ = TYP_AUTO;
+        void *mat;
+        kod = wczytaj_binarnie(&z, &typ, &mat, &o->rows, &o->cols);
+        if (!kod) {
+            o->zespolona = typ == TYP_COMPLEX;
+            size_t n = (size_t)o->rows * o->cols * (o->zespolona ? 2 : 1);
+            double *d = malloc(n * sizeof(double));
+            if (d) for (size_t i = 0; i < n; ++i) d[i] = ((const float *)mat)[i];
+            else kod = 4;
+            zwolnij_macierz(mat);
+            o->dane = d;
         }
-        fprintf(f, "\n");
+    } else {
+        long nnz;
+        kod = wczytaj_naglowek(&z, &o->rows, &o->cols, &nnz);
+        if (!kod) kod = nnz >= 0 ? trojki_f64(&z, o, nnz) : gesty_f64(&z, o);
     }
-    fclose(f);
+    zamknij_zrodlo(&z);
+    faza_wyjdz(f);
+    if (kod) { free(o->dane); o->dane = NULL; }
+    return kod;
+}
+static int na_zespolony_f64(Operand *o) {
+    if (o->zespolona) return 0;
+    size_t n = (size_t)o->rows * o->cols;
+    void *c = rozszerz_na_complex_d(o->dane, n, n);
+    if (!c) return 4;
+    o->dane = c; o->zespolona = 1;
     return 0;
 }
-void dodaj_macierze_complex(const Complex *a, const Complex *b, Complex *wynik, int rows, int cols) {
-    for (int i = 0; i < rows * cols; ++i) {
-        wynik[i].re = a[i].re + b[i].re;
-        wynik[i].im = a[i].im + b[i].im;
+
+static int zapisz_f64(const char *outfile, const Operand *w) {
+    int typ = w->zespolona ? TYP_C64 : TYP_F64;
+    if (!nazwa_binarna(outfile)) return zapisz_plik_tekstowy(outfile, typ, w->dane, w->rows, w->cols);
+    size_t n = (size_t)w->rows * w->cols * (w->zespolona ? 2 : 1);
+    float *f = malloc(n * sizeof(float));
+    if (!f) return 1;
+    for (size_t i = 0; i < n; ++i) f[i] = (float)((const double *)w->dane)[i];
+    int kod = zapisz_binarnie(outfile, w->zespolona ? TYP_COMPLEX : TYP_FLOAT, f, w->rows, w->cols);
+    free(f);
+    return kod;
+}
+static void wypisz_f64(const char *tytul, const Operand *w, const char *outfile) {
+    if (!opcje.cichy) {
+        fflush(stdout);
+        dprintf(STDOUT_FILENO, "%s:\n", tytul);
+        zapisz_tekstowo(STDOUT_FILENO, w->zespolona ? TYP_C64 : TYP_F64, w->dane, w->rows, w->cols);
     }
+    if (outfile && zapisz_f64(outfile, w)) fprintf(stderr, "Blad zapisu %s\n", outfile);
 }
-void odejmij_macierze_complex(const Complex *a, const Complex *b, Complex *wynik, int rows, int cols) {
-    for (int i = 0; i < rows * cols; ++i) {
-        wynik[i].re = a[i].re - b[i].re;
-        wynik[i].im = a[i].im - b[i].im;
+
+typedef struct { const double *a, *b; double *c; int plus; size_t n; } ZadanieSumyD;
+static void suma_d_zakres(void *ctx, long i) {
+    ZadanieSumyD *z = ctx;
+    size_t lo = (size_t)i * EW_ZAKRES, hi = lo + EW_ZAKRES < z->n ? lo + EW_ZAKRES : z->n;
+    if (z->plus) for (size_t j = lo; j < hi; ++j) z->c[j] = z->a[j] + z->b[j];
+    else for (size_t j = lo; j < hi; ++j) z->c[j] = z->a[j] - z->b[j];
+}
+static int transpozycja_f64(const char *infile, const char *outfile) {
+    Operand o;
+    if (wczytaj_f64(infile, &o) != 0) { fprintf(stderr, "Blad wczytywania %s\n", infile); return 1; }
+    Operand t = { 0, o.cols, o.rows, o.zespolona, malloc((size_t)o.rows * o.cols * (o.zespolona ? sizeof(ComplexD) : sizeof(double))), { 0 } };
+    if (!t.dane) { fprintf(stderr, "Brak pamieci!\n"); free(o.dane); return 1; }
+    // double ma rozmiar Complex, wiec transpozycja blokowa float sie nadaje; ComplexD prosto.
+    if (!o.zespolona) transpozycja(o.dane, t.dane, o.rows, o.cols, 1);
+    else
+        for (int i = 0; i < o.rows; ++i)
+            for (int j = 0; j < o.cols; ++j) ((ComplexD *)t.dane)[(size_t)j * o.rows + i] = ((const ComplexD *)o.dane)[(size_t)i * o.cols + j];
+    free(o.dane);
+    wypisz_f64("Transpozycja macierzy", &t, outfile);
+    free(t.dane);
+    return 0;
+}
+// Dzialanie z main przy --precision f64: +, - i * w calosci w double.
+static int dzialanie_f64(const char *file1, const char *op, const char *file2, const char *outfile) {
+    int plus = strcmp(op, "+") == 0, minus = strcmp(op, "-") == 0, razy = strcmp(op, "*") == 0;
+    if (!plus && !minus && !razy) { fprintf(stderr, "Nieznana operacja: %s\n", op); return 1; }
+    Operand a, b;
+    if (wczytaj_f64(file1, &a) != 0) { fprintf(stderr, "Blad wczytywania %s\n", file1); return 1; }
+    if (wczytaj_f64(file2, &b) != 0) { fprintf(stderr, "Blad wczytywania %s\n", file2); free(a.dane); return 1; }
+    int kod = 0;
+    const char *tytul = NULL;
+    Operand w = { 0, a.rows, b.cols, 0, NULL, { 0 } };
+    if ((a.zespolona || b.zespolona) && (na_zespolony_f64(&a) || na_zespolony_f64(&b))) kod = 2;
+    else if (!razy && (a.rows != b.rows || a.cols != b.cols)) {
+        fprintf(stderr, plus ? "Nie mozna dodac macierzy o roznych rozmiarach!\n" : "Nie mozna odjac macierzy o roznych rozmiarach!\n");
+        kod = 1;
+    } else if (razy && a.cols != b.rows) {
+        fprintf(stderr, "Nie mozna mnozyc: liczba kolumn macierzy 1 musi byc rowna liczbie wierszy macierzy 2!\n");
+        kod = 1;
+    }
+    w.zespolona = a.zespolona;
+    size_t el = w.zespolona ? sizeof(ComplexD) : sizeof(double);
+    if (!kod && (w.dane = malloc((size_t)w.rows * w.cols * el)) == NULL) kod = 2;
+    if (!kod && razy) {
+        tytul = "Iloczyn macierzy";
+        ComplexD jeden = { 1.0, 0.0 };
+        if (w.zespolona) kod = cgemm_d(a.rows, b.cols, a.cols, jeden, a.dane, 0, a.cols, 1, b.dane, 0, b.cols, 1, 0, w.dane, 0, b.cols) ? 2 : 0;
+        else kod = gemm_d(a.rows, b.cols, a.cols, 1.0, a.dane, 0, a.cols, 1, b.dane, 0, b.cols, 1, 0, w.dane, 0, b.cols) ? 2 : 0;
+        dolicz_flop((w.zespolona ? 8.0 : 2.0) * a.rows * a.cols * b.cols);
+    } else if (!kod) {
+        tytul = plus ? "Suma macierzy" : "Roznica macierzy";
+        ZadanieSumyD z = { a.dane, b.dane, w.dane, plus, (size_t)a.rows * a.cols * (w.zespolona ? 2 : 1) };
+        rownolegle((long)((z.n + EW_ZAKRES - 1) / EW_ZAKRES), suma_d_zakres, &z);
+        dolicz_flop((double)z.n);
     }
+    free(a.dane); free(b.dane);
+    if (kod == 2) fprintf(stderr, "Brak pamieci!\n");
+    if (!kod) wypisz_f64(tytul, &w, outfile);
+    free(w.dane);
+    return kod ? 1 : 0;
 }
-void mnoz_macierze_complex(const Complex *a, int a_rows, int a_cols, const Complex *b, int b_rows, int b_cols, Complex *wynik) {
-    for (int i = 0; i < a_rows; ++i) {
-        for (int j = 0; j < b_cols; ++j) {
-            Complex sum = {0,0};
-            for (int k = 0; k < a_cols; ++k) {
-                float ar = a[i*a_cols+k].re, ai = a[i*a_cols+k].im;
-                float br = b[k*b_cols+j].re, bi = b[k*b_cols+j].im;
-                sum.re += ar*br - ai*bi;
-                sum.im += ar*bi + ai*br;
+
+// --- Tryb wyrazen (-e) ---
+// Wyrazenie z +, -, *, ^ i nawiasami rozwijane jest do sumy skladnikow +-X lub +-X*Y, gdzie X i Y
+// to widoki macierzy (transpozycja to zamiana krokow, bez kopiowania). Skladniki X sumowane sa
+// jednym przebiegiem strumieniowym, a iloczyny dopisywane w epilogu GEMM (akumuluj, alpha = +-1).
+// Macierz posrednia powstaje tylko dla czynnika iloczynu, ktory sam jest suma lub iloczynem.
+enum { W_ZMIENNA, W_TRANSP, W_MINUS, W_DODAJ, W_ODEJMIJ, W_MNOZ };
+#define WYR_WEZLY 256
+#define WYR_ZMIENNE 64
+typedef struct { int rodzaj, l, p, rows, cols; } WezelWyr;     // dla W_ZMIENNA l to indeks zmiennej
+typedef struct { const char *nazwa; size_t dl; const char *plik; void *dane; int rows, cols, zespolona; } ZmiennaWyr;
+typedef struct { const void *dane; int rows, cols; long rs, cs; } Widok;
+typedef struct { int znak, iloczyn; Widok a, b; } Skladnik;
+typedef struct {
+    const char *tekst, *p, *blad;
+    int typ;
+    WezelWyr w[WYR_WEZLY]; int nw;
+    ZmiennaWyr z[WYR_ZMIENNE]; int nz;
+    void *tymczasowe[WYR_WEZLY]; int nt;
+} Wyrazenie;
+
+static int wyr_wezel(Wyrazenie *x, int rodzaj, int l, int p, int rows, int cols) {
+    if (x->nw >= WYR_WEZLY) { x->blad = "zbyt dlugie wyrazenie"; return -1; }
+    WezelWyr *w = &x->w[x->nw];
+    w->rodzaj = rodzaj; w->l = l; w->p = p; w->rows = rows; w->cols = cols;
+    return x->nw++;
+}
+static void wyr_spacje(Wyrazenie *x) { while (bialy_znak(*x->p)) x->p++; }
+static int wyr_suma(Wyrazenie *x);
+// czynnik := nazwa | '(' suma ')' | '-' czynnik, z dowolna liczba przyrostkow '^'
+static int wyr_czynnik(Wyrazenie *x) {
+    int w;
+    wyr_spacje(x);
+    if (*x->p == '(') {
+        x->p++;
+        if ((w = wyr_suma(x)) < 0) return -1;
+        wyr_spacje(x);
+        if (*x->p != ')') { x->blad = "oczekiwano ')'"; return -1; }
+        x->p++;
+    } else if (*x->p == '-') {
+        x->p++;
+        if ((w = wyr_czynnik(x)) < 0) return -1;
+        return wyr_wezel(x, W_MINUS, w, -1, x->w[w].rows, x->w[w].cols);
+    } else if (isalpha((unsigned char)*x->p) || *x->p == '_') {
+        const char *s = x->p;
+        while (isalnum((unsigned char)*x->p) || *x->p == '_') x->p++;
+        size_t dl = (size_t)(x->p - s);
+        int i = 0;
+        while (i < x->nz && !(x->z[i].dl == dl && memcmp(x->z[i].nazwa, s, dl) == 0)) ++i;
+        if (i == x->nz) { x->p = s; x->blad = "nieznana macierz"; return -1; }
+        w = wyr_wezel(x, W_ZMIENNA, i, -1, x->z[i].rows, x->z[i].cols);
+    } else {
+        x->blad = "oczekiwano nazwy macierzy lub '('";
+        return -1;
+    }
+    for (;;) {
+        wyr_spacje(x);
+        if (w < 0 || *x->p != '^') return w;
+        x->p++;
+        w = wyr_wezel(x, W_TRANSP, w, -1, x->w[w].cols, x->w[w].rows);
+    }
+}
+static int wyr_iloczyn(Wyrazenie *x) {
+    int w = wyr_czynnik(x);
+    for (;;) {
+        wyr_spacje(x);
+        if (w < 0 || *x->p != '*') return w;
+        const char *op = x->p++;
+        int p = wyr_czynnik(x);
+        if (p < 0) return -1;
+        if (x->w[w].cols != x->w[p].rows) { x->p = op; x->blad = "liczba kolumn lewego czynnika rozna od liczby wierszy prawego"; return -1; }
+        w = wyr_wezel(x, W_MNOZ, w, p, x->w[w].rows, x->w[p].cols);
+    }
+}
+static int wyr_suma(Wyrazenie *x) {
+    int w = wyr_iloczyn(x);
+    for (;;) {
+        wyr_spacje(x);
+        if (w < 0 || (*x->p != '+' && *x->p != '-')) return w;
+        const char *op = x->p++;
+        int p = wyr_iloczyn(x);
+        if (p < 0) return -1;
+        if (x->w[w].rows != x->w[p].rows || x->w[w].cols != x->w[p].cols) { x->p = op; x->blad = "rozne rozmiary macierzy"; return -1; }
+        w = wyr_wezel(x, *op == '+' ? W_DODAJ : W_ODEJMIJ, w, p, x->w[w].rows, x->w[w].cols);
+    }
+}
+
+static int wyr_oblicz(Wyrazenie *x, int w, void *wynik);
+// Widok wezla jako czynnika iloczynu. Minus wychodzi przed iloczyn przez *znak; suma albo
+// iloczyn jest liczony do macierzy tymczasowej.
+static int wyr_widok(Wyrazenie *x, int w, int trans, int *znak, Widok *v) {
+    const WezelWyr *n = &x->w[w];
+    if (n->rodzaj == W_TRANSP) return wyr_widok(x, n->l, !trans, znak, v);
+    if (n->rodzaj == W_MINUS) { *znak = -*znak; return wyr_widok(x, n->l, trans, znak, v); }
+    if (n->rodzaj == W_ZMIENNA) v->dane = x->z[n->l].dane;
+    else {
+        void *t = malloc((size_t)n->rows * n->cols * (x->typ == TYP_COMPLEX ? sizeof(Complex) : sizeof(float)));
+        if (!t) return 4;
+        x->tymczasowe[x->nt++] = t;
+        int kod = wyr_oblicz(x, w, t);
+        if (kod) return kod;
+        v->dane = t;
+    }
+    v->rows = trans ? n->cols : n->rows; v->cols = trans ? n->rows : n->cols;
+    v->rs = trans ? 1 : n->cols; v->cs = trans ? n->cols : 1;
+    return 0;
+}
+// Rozwija sumy, roznice, minusy i transpozycje az do lisci lub iloczynow; (L*P)^ = P^ * L^.
+static int wyr_rozwin(Wyrazenie *x, int w, int znak, int trans, Skladnik *s, int *ns) {
+    const WezelWyr *n = &x->w[w];
+    if (n->rodzaj == W_TRANSP) return wyr_rozwin(x, n->l, znak, !trans, s, ns);
+    if (n->rodzaj == W_MINUS) return wyr_rozwin(x, n->l, -znak, trans, s, ns);
+    if (n->rodzaj == W_DODAJ || n->rodzaj == W_ODEJMIJ) {
+        int kod = wyr_rozwin(x, n->l, znak, trans, s, ns);
+        return kod ? kod : wyr_rozwin(x, n->p, n->rodzaj == W_DODAJ ? znak : -znak, trans, s, ns);
+    }
+    Skladnik *k = &s[(*ns)++];              // kazdy skladnik ma wlasny lisc, wiec *ns < WYR_WEZLY
+    k->znak = znak;
+    k->iloczyn = n->rodzaj == W_MNOZ;
+    if (!k->iloczyn) return wyr_widok(x, w, trans, &k->znak, &k->a);
+    int kod = wyr_widok(x, trans ? n->p : n->l, trans, &k->znak, &k->a);
+    return kod ? kod : wyr_widok(x, trans ? n->l : n->p, trans, &k->znak, &k->b);
+}
+
+// Przebieg strumieniowy: kafelek wyniku dostaje po kolei wszystkie skladniki bez iloczynu.
+// Wiersz widoku transponowanego jest zbierany do bufora, a dalej dzialaja jadra dodaj/odejmij;
+// Complex idzie jako 2n floatow, tak jak w dodaj_macierze_complex.
+#define WYR_KAFEL_W 64
+#define WYR_KAFEL_K 256
+typedef struct { const Skladnik *s; int ns, typ, rows, cols, kafle_k; void *wynik; } ZadanieSumy;
+static void wyr_suma_kafelek(void *ctx, long t) {
+    ZadanieSumy *z = ctx;
+    int i0 = (int)(t / z->kafle_k) * WYR_KAFEL_W, j0 = (int)(t % z->kafle_k) * WYR_KAFEL_K;
+    int i1 = i0 + WYR_KAFEL_W < z->rows ? i0 + WYR_KAFEL_W : z->rows;
+    int nj = z->cols - j0 < WYR_KAFEL_K ? z->cols - j0 : WYR_KAFEL_K;
+    long el = z->typ == TYP_COMPLEX ? 2 : 1;       // floatow na element
+    size_t n = (size_t)nj * el;
+    float bufor[2 * WYR_KAFEL_K];
+    for (int i = i0; i < i1; ++i) {
+        float *w = (float *)z->wynik + ((size_t)i * z->cols + j0) * el;
+        int pierwszy = 1;
+        for (int k = 0; k < z->ns; ++k) {
+            const Skladnik *s = &z->s[k];
+            if (s->iloczyn) continue;
+            const float *src = (const float *)s->a.dane + ((long)i * s->a.rs + (long)j0 * s->a.cs) * el;
+            if (s->a.cs != 1) {
+                for (int j = 0; j < nj; ++j)
+                    for (long c = 0; c < el; ++c) bufor[j * el + c] = src[(long)j * s->a.cs * el + c];
+                src = bufor;
+            }
+            if (pierwszy && s->znak > 0) memcpy(w, src, n * sizeof(float));
+            else {
+                if (pierwszy) memset(w, 0, n * sizeof(float));
+                (s->znak > 0 ? jadra.dodaj : jadra.odejmij)(w, src, w, n);
             }
-            wynik[i*b_cols+j] = sum;
+            pierwszy = 0;
         }
     }
 }
-void transpose_complex(const Complex *src, Complex *dst, int rows, int cols) {
-    for (int i = 0; i < rows; ++i)
-        for (int j = 0; j < cols; ++j)
-            dst[j * rows + i] = src[i * cols + j];
+// Oblicza wezel w do ciaglej macierzy wynik (rows x cols wezla).
+static int wyr_oblicz(Wyrazenie *x, int w, void *wynik) {
+    const WezelWyr *n = &x->w[w];
+    Skladnik *s = malloc(WYR_WEZLY * sizeof(Skladnik));
+    if (!s) return 4;
+    int ns = 0, suma = 0;
+    int kod = wyr_rozwin(x, w, 1, 0, s, &ns);
+    for (int k = 0; k < ns; ++k) suma |= !s[k].iloczyn;
+    if (!kod && suma) {
+        ZadanieSumy z = { s, ns, x->typ, n->rows, n->cols, (n->cols + WYR_KAFEL_K - 1) / WYR_KAFEL_K, wynik };
+        rownolegle((long)((n->rows + WYR_KAFEL_W - 1) / WYR_KAFEL_W) * z.kafle_k, wyr_suma_kafelek, &z);
+    }
+    // Iloczyny dopisywane do wyniku w GEMM; pierwszy nadpisuje, gdy nie bylo skladnikow sumy.
+    int akumuluj = suma;
+    for (int k = 0; k < ns && !kod; ++k) {
+        if (!s[k].iloczyn) continue;
+        const Widok *a = &s[k].a, *b = &s[k].b;
+        if (x->typ == TYP_COMPLEX) {
+            Complex alfa = { (float)s[k].znak, 0.0f };
+            kod = gemm_c32(a->rows, b->cols, a->cols, alfa, a->dane, a->rs, a->cs, b->dane, b->rs, b->cs, akumuluj, wynik, n->cols) ? 4 : 0;
+        } else {
+            kod = gemm_f32(a->rows, b->cols, a->cols, (float)s[k].znak, a->dane, a->rs, a->cs, b->dane, b->rs, b->cs, akumuluj, wynik, n->cols) ? 4 : 0;
+        }
+        akumuluj = 1;
+    }
+    free(s);
+    return kod;
+}
+
+// argv: wyrazenie, potem przypisania NAZWA=plik i opcjonalnie -o wynik.
+static int oblicz_wyrazenie(int argc, char **argv) {
+    Wyrazenie *x = calloc(1, sizeof(Wyrazenie));
+    const char *wyjscie = NULL;
+    void *wynik = NULL;
+    int kod = 1;
+    if (!x) return 1;
+    x->tekst = argv[0];
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 >= argc) { fprintf(stderr, "Brak nazwy pliku po -o\n"); goto koniec; }
+            wyjscie = argv[++i];
+            continue;
+        }
+        const char *rown = strchr(argv[i], '=');
+        const char *c = argv[i];
+        if (rown && rown > c && !isdigit((unsigned char)*c))
+            while (c < rown && (isalnum((unsigned char)*c) || *c == '_')) ++c;
+        if (!rown || c != rown || rown == argv[i] || rown[1] == '\0') {
+            fprintf(stderr, "Nieprawidlowe przypisanie: %s (oczekiwano NAZWA=plik)\n", argv[i]);
+            goto koniec;
+        }
+        size_t dl = (size_t)(rown - argv[i]);
+        for (int j = 0; j < x->nz; ++j)
+            if (x->z[j].dl == dl && memcmp(x->z[j].nazwa, argv[i], dl) == 0) {
+                fprintf(stderr, "Macierz %.*s przypisana dwukrotnie\n", (int)dl, argv[i]);
+                goto koniec;
+            }
+        if (x->nz >= WYR_ZMIENNE) { fprintf(stderr, "Zbyt wiele macierzy w wyrazeniu\n"); goto koniec; }
+        ZmiennaWyr *z = &x->z[x->nz++];
+        z->nazwa = argv[i]; z->dl = dl; z->plik = rown + 1;
+    }
+    // Jeden typ dla calego wyrazenia: kazda macierz jest czytana raz, z typem wykrytym przy
+    // parsowaniu, a gdy ktorakolwiek jest zespolona, rzeczywiste sa potem rozszerzane do Complex.
+    x->typ = TYP_FLOAT;
+    for (int i = 0; i < x->nz; ++i) {
+        ZmiennaWyr *z = &x->z[i];
+        Operand o;
+        if (wczytaj_operand(z->plik, TYP_AUTO, 0.0, &o) != 0) { fprintf(stderr, "Blad wczytywania %s\n", z->plik); goto koniec; }
+        z->dane = o.dane; z->rows = o.rows; z->cols = o.cols; z->zespolona = o.zespolona;
+        if (o.zespolona) x->typ = TYP_COMPLEX;
+    }
+    for (int i = 0; i < x->nz && x->typ == TYP_COMPLEX; ++i) {
+        ZmiennaWyr *z = &x->z[i];
+        if (z->zespolona) continue;
+        Operand o = { 0, z->rows, z->cols, 0, z->dane, { 0 } }, c;
+        if (na_zespolony(&o, &c) != 0) { fprintf(stderr, "Brak pamieci!\n"); goto koniec; }
+        zwolnij_macierz(z->dane);
+        z->dane = c.dane; z->zespolona = 1;
+    }
+    x->p = x->tekst;
+    int w = wyr_suma(x);
+    if (w >= 0) {
+        wyr_spacje(x);
+        if (*x->p) { x->blad = "nieoczekiwany znak"; w = -1; }
+    }
+    if (w < 0) {
+        int poz = (int)(x->p - x->tekst);
+        fprintf(stderr, "Blad w wyrazeniu (pozycja %d): %s\n  %s\n  %*s^\n", poz + 1, x->blad, x->tekst, poz, "");
+        goto koniec;
+    }
+    int rows = x->w[w].rows, cols = x->w[w].cols;
+    wynik = malloc((size_t)rows * cols * (x->typ == TYP_COMPLEX ? sizeof(Complex) : sizeof(float)));
+    if (!wynik || wyr_oblicz(x, w, wynik) != 0) { fprintf(stderr, "Brak pamieci!\n"); goto koniec; }
+    if (x->typ == TYP_COMPLEX) {
+        if (!opcje.cichy) { printf("Wynik wyrazenia:\n"); wypisz_macierz_complex(wynik, rows, cols); }
+        if (wyjscie && save_matrix_complex(wyjscie, wynik, rows, cols) != 0) { fprintf(stderr, "Blad zapisu %s\n", wyjscie); goto koniec; }
+    } else {
+        if (!opcje.cichy) { printf("Wynik wyrazenia:\n"); wypisz_macierz(wynik, rows, cols); }
+        if (wyjscie && save_matrix_float(wyjscie, wynik, rows, cols) != 0) { fprintf(stderr, "Blad zapisu %s\n", wyjscie); goto koniec; }
+    }
+    kod = 0;
+koniec:
+    for (int i = 0; i < x->nt; ++i) free(x->tymczasowe[i]);
+    for (int i = 0; i < x->nz; ++i) zwolnij_macierz(x->z[i].dane);
+    free(wynik);
+    free(x);
+    return kod;
+}
+
+// --- Tryb wsadowy i serwer (batch, serve) ---
+// Polecenia w skladni main ("a op b [wynik]", "a ^ [wynik]"), po jednym w wierszu, czytane z pliku,
+// stdin albo gniazda uniksowego. Wczytane macierze zostaja w pamieci podrecznej LRU kluczowanej
+// sciezka, czasem modyfikacji i rozmiarem pliku. Polecenia bez wspolnych plikow wynikowych
+// wykonuja sie rownolegle; wyniki wypisywane sa w kolejnosci polecen.
+typedef struct WpisPamieci {
+    char *sciezka;
+    struct timespec mtime;
+    off_t rozmiar;
+    int jest;                   // czy op wczytany (typ wykryty przy wczytaniu)
+    Operand op;
+    size_t bajty;
+    int odwolania, wyjety;      // wyjety: juz poza lista (nieaktualny albo usuniety)
+    pthread_mutex_t ladowanie;
+    struct WpisPamieci *pop, *nast;
+} WpisPamieci;
+
+static struct {
+    WpisPamieci *glowa, *ogon;  // glowa - ostatnio uzywany
+    size_t bajty;
+    long trafienia, chybienia, usuniete;
+    pthread_mutex_t mutex;
+} pamiec = { NULL, NULL, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+
+static size_t rozmiar_operandu(const Operand *o) {
+    if (o->rzadka) return (size_t)o->r.nnz * (rozmiar_el(o->zespolona) + sizeof(int)) + ((size_t)o->rows + 1) * sizeof(long);
+    return (size_t)o->rows * o->cols * rozmiar_el(o->zespolona);
+}
+static int zmapowana(const void *p) {
+    int wynik = 0;
+    pthread_mutex_lock(&mapowania.mutex);
+    for (int i = 0; i < mapowania.n && !wynik; ++i) wynik = mapowania.tab[i].dane == p;
+    pthread_mutex_unlock(&mapowania.mutex);
+    return wynik;
+}
+
+// Ponizsze pod pamiec.mutex.
+static void pamiec_odlacz(WpisPamieci *w) {
+    if (w->pop) w->pop->nast = w->nast; else pamiec.glowa = w->nast;
+    if (w->nast) w->nast->pop = w->pop; else pamiec.ogon = w->pop;
+    w->pop = w->nast = NULL;
+}
+static void pamiec_na_poczatek(WpisPamieci *w) {
+    w->pop = NULL; w->nast = pamiec.glowa;
+    if (pamiec.glowa) pamiec.glowa->pop = w; else pamiec.ogon = w;
+    pamiec.glowa = w;
+}
+static void pamiec_zwolnij_wpis(WpisPamieci *w) {
+    if (w->jest) zwolnij_operand(&w->op);
+    pamiec.bajty -= w->bajty;
+    pthread_mutex_destroy(&w->ladowanie);
+    free(w->sciezka);
+    free(w);
+}
+// Wpis w uzyciu jest zwalniany przy ostatnim pamiec_oddaj.
+static void pamiec_wyjmij(WpisPamieci *w) {
+    pamiec_odlacz(w);
+    w->wyjety = 1;
+    if (w->odwolania == 0) pamiec_zwolnij_wpis(w);
+}
+static void pamiec_przytnij(void) {
+    WpisPamieci *w = pamiec.ogon;
+    while (w && pamiec.bajty > opcje.pamiec_podreczna) {
+        WpisPamieci *pop = w->pop;
+        if (w->odwolania == 0) { pamiec.usuniete++; pamiec_wyjmij(w); }
+        w = pop;
+    }
+}
+
+// Wpis dla pliku (z odwolaniem); wpis o tej samej sciezce, ale innym czasie lub rozmiarze, jest wyjmowany.
+static WpisPamieci *pamiec_wez(const char *sciezka) {
+    struct stat st;
+    if (stat(sciezka, &st) != 0 || !S_ISREG(st.st_mode)) { fprintf(stderr, "Nie mozna otworzyc pliku %s\n", sciezka); return NULL; }
+    pthread_mutex_lock(&pamiec.mutex);
+    WpisPamieci *w = pamiec.glowa;
+    while (w && strcmp(w->sciezka, sciezka) != 0) w = w->nast;
+    if (w && (w->rozmiar != st.st_size || w->mtime.tv_sec != st.st_mtim.tv_sec || w->mtime.tv_nsec != st.st_mtim.tv_nsec)) {
+        pamiec_wyjmij(w);
+        w = NULL;
+    }
+    if (w) pamiec_odlacz(w);
+    else if ((w = calloc(1, sizeof(*w))) != NULL && (w->sciezka = strdup(sciezka)) != NULL) {
+        w->mtime = st.st_mtim;
+        w->rozmiar = st.st_size;
+        pthread_mutex_init(&w->ladowanie, NULL);
+    } else { free(w); w = NULL; }
+    if (w) { w->odwolania++; pamiec_na_poczatek(w); }
+    pthread_mutex_unlock(&pamiec.mutex);
+    if (!w) fprintf(stderr, "Brak pamieci!\n");
+    return w;
+}
+static void pamiec_oddaj(WpisPamieci *w) {
+    pthread_mutex_lock(&pamiec.mutex);
+    if (--w->odwolania == 0 && w->wyjety) pamiec_zwolnij_wpis(w);
+    else pamiec_przytnij();
+    pthread_mutex_unlock(&pamiec.mutex);
+}
+// Wywolywane przed zapisem pliku wynikowego: czas modyfikacji moze sie nie zmienic w obrebie taktu zegara.
+static void pamiec_uniewaznij(const char *sciezka) {
+    pthread_mutex_lock(&pamiec.mutex);
+    for (WpisPamieci *w = pamiec.glowa; w; w = w->nast)
+        if (strcmp(w->sciezka, sciezka) == 0) { pamiec_wyjmij(w); break; }
+    pthread_mutex_unlock(&pamiec.mutex);
+}
+// Argument z typem wykrytym przy wczytaniu; polecenia czekajace na ten sam plik korzystaja z jednego wczytania.
+// Dane z mapowania pliku binarnego sa kopiowane: wpis zyje dlugo, a obciecie pliku przez inny
+// proces konczyloby sie SIGBUS przy dostepie do mapowania.
+static const Operand *pamiec_operand(WpisPamieci *w) {
+    pthread_mutex_lock(&w->ladowanie);
+    int trafienie = w->jest;
+    if (!trafienie && wczytaj_operand(w->sciezka, TYP_AUTO, opcje.prog_rzadkosci, &w->op) == 0) {
+        Operand *o = &w->op;
+        size_t n = rozmiar_operandu(o);
+        if (!o->rzadka && zmapowana(o->dane)) {
+            void *kopia = malloc(n ? n : 1);
+            if (kopia) { memcpy(kopia, o->dane, n); zwolnij_macierz(o->dane); o->dane = kopia; }
+            else zwolnij_operand(o);
+        }
+        if (o->rzadka || o->dane) {
+            w->jest = 1;
+            pthread_mutex_lock(&pamiec.mutex);
+            w->bajty += n;
+            pamiec.bajty += n;
+            pthread_mutex_unlock(&pamiec.mutex);
+        } else fprintf(stderr, "Brak pamieci!\n");
+    }
+    const Operand *o = w->jest ? &w->op : NULL;
+    pthread_mutex_unlock(&w->ladowanie);
+    pthread_mutex_lock(&pamiec.mutex);
+    if (trafienie) pamiec.trafienia++; else pamiec.chybienia++;
+    pthread_mutex_unlock(&pamiec.mutex);
+    return o;
+}
+static void raport_pamieci(int fd) {
+    pthread_mutex_lock(&pamiec.mutex);
+    long n = pamiec.trafienia + pamiec.chybienia;
+    dprintf(fd, "Pamiec podreczna: %ld trafien, %ld chybien (%.1f%% trafien), %ld usunietych, %.1f MB w pamieci\n",
+            pamiec.trafienia, pamiec.chybienia, n ? 100.0 * pamiec.trafienia / n : 0.0, pamiec.usuniete,
+            pamiec.bajty / (1024.0 * 1024.0));
+    pthread_mutex_unlock(&pamiec.mutex);
+}
+
+// Transpozycja bez zmiany argumentu (jest wspoldzielony przez pamiec podreczna).
+static int transponuj_operand(const Operand *a, Operand *t) {
+    memset(t, 0, sizeof(*t));
+    t->rows = a->cols; t->cols = a->rows; t->zespolona = a->zespolona;
+    int kod = 0;
+    if (a->rzadka) { t->rzadka = 1; kod = rzadka_transpozycja(&a->r, &t->r); }
+    else if ((t->dane = malloc((size_t)a->rows * a->cols * rozmiar_el(a->zespolona))) == NULL) kod = 4;
+    else transpozycja(a->dane, t->dane, a->rows, a->cols, a->zespolona);
+    if (kod) { fprintf(stderr, "Brak pamieci!\n"); return 1; }
+    return 0;
+}
+
+// Bufory watku (pakowanie GEMM, akumulator SpGEMM) - watki polecen koncza sie po kazdym poleceniu.
+static void zwolnij_bufory_watku(void) {
+    free(bufor_a); free(bufor_b); free(bufor_c);
+    bufor_a = bufor_b = bufor_c = NULL; bufor_a_n = bufor_b_n = bufor_c_n = 0;
+    free(spa_znacznik); free(spa_lista); free(spa_wart);
+    spa_znacznik = spa_lista = NULL; spa_wart = NULL; spa_n = 0;
+}
+
+#define WSAD_ARG 4
+typedef struct Sesja Sesja;
+typedef struct {
+    Sesja *s;
+    long nr;
+    int argc;
+    char *arg[WSAD_ARG];
+    const char *we[2], *wy;     // pliki czytane i zapisywany (do wykrywania zaleznosci)
+    char *tekst;                // kopia wiersza, na ktora wskazuja arg
+} Polecenie;
+struct Sesja {
+    int fd_wy;
+    int protokol;               // gniazdo: kazda odpowiedz konczy wiersz OK albo BLAD
+    int limit;                  // rownolegle polecenia
+    pthread_mutex_t mutex;
+    pthread_cond_t zmiana;
+    long wydane, wypisane;      // numer nastepnego polecenia i polecenia, ktore teraz wypisuje wynik
+    int aktywne, bledy;
+    Polecenie **w_toku;
+};
+
+// Serwer konczy przyjmowanie polecen po SIGINT/SIGTERM albo poleceniu quit i czeka na rozpoczete.
+static volatile sig_atomic_t koniec_serwera = 0;
+static struct {
+    int biegnace;
+    pthread_mutex_t mutex;
+    pthread_cond_t zmiana;
+} polecenia = { 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+// Dzieli wiersz na slowa; 0 - wiersz pusty albo komentarz (#), -1 - brak pamieci. Za duzo slow
+// zostawia argc = -1, a blad zglasza polecenie w swojej kolejce.
+static int podziel_polecenie(const char *p, const char *e, Polecenie *pol) {
+    if ((pol->tekst = malloc((size_t)(e - p) + 1)) == NULL) return -1;
+    memcpy(pol->tekst, p, (size_t)(e - p));
+    pol->tekst[e - p] = '\0';
+    char *zapis = NULL;
+    for (char *t = strtok_r(pol->tekst, " \t\r", &zapis); t; t = strtok_r(NULL, " \t\r", &zapis)) {
+        if (pol->argc == 0 && t[0] == '#') break;
+        if (pol->argc == WSAD_ARG) { pol->argc = -1; return 1; }
+        pol->arg[pol->argc++] = t;
+    }
+    if (pol->argc >= 2) {
+        int trans = strcmp(pol->arg[1], "^") == 0;
+        pol->we[0] = pol->arg[0];
+        pol->we[1] = !trans && pol->argc >= 3 ? pol->arg[2] : NULL;
+        pol->wy = pol->argc == (trans ? 3 : 4) ? pol->arg[pol->argc - 1] : NULL;
+    }
+    return pol->argc > 0;
+}
+static int czyta_lub_pisze(const Polecenie *p, const char *plik) {
+    return (p->we[0] && strcmp(p->we[0], plik) == 0) || (p->we[1] && strcmp(p->we[1], plik) == 0) ||
+           (p->wy && strcmp(p->wy, plik) == 0);
+}
+// Polecenie czeka na wczesniejsze, ktore zapisuje plik przez nie uzywany albo czyta plik, ktory ono zapisuje.
+static int koliduje(const Sesja *s, const Polecenie *p) {
+    for (int i = 0; i < s->aktywne; ++i) {
+        const Polecenie *q = s->w_toku[i];
+        if ((q->wy && czyta_lub_pisze(p, q->wy)) || (p->wy && czyta_lub_pisze(q, p->wy))) return 1;
+    }
+    return 0;
+}
+
+static int oblicz_polecenie(const Polecenie *p, Operand *w, const char **tytul, int *ptyp) {
+    memset(w, 0, sizeof(*w));
+    if (p->argc < 0) { fprintf(stderr, "Za duzo argumentow!\n"); return 1; }
+    if (p->argc < 2) { fprintf(stderr, "Za malo argumentow!\n"); return 1; }
+    int trans = strcmp(p->arg[1], "^") == 0;
+    if (trans && p->argc > 3) { fprintf(stderr, "Za duzo argumentow!\n"); return 1; }
+    if (!trans && p->argc < 3) { fprintf(stderr, "Za malo argumentow!\n"); return 1; }
+    for (int i = 0; i < 2; ++i)
+        if (p->we[i] && strcmp(p->we[i], "-") == 0) { fprintf(stderr, "Tryb wsadowy nie czyta macierzy ze stdin!\n"); return 1; }
+    WpisPamieci *a = pamiec_wez(p->we[0]), *b = NULL;
+    if (!a) return 1;
+    int kod = 1;
+    const Operand *oa = pamiec_operand(a), *ob;
+    if (!oa) fprintf(stderr, "Blad wczytywania %s\n", p->we[0]);
+    else if (trans) {
+        *tytul = "Transpozycja macierzy";
+        kod = transponuj_operand(oa, w);
+    } else if ((b = pamiec_wez(p->we[1])) != NULL) {
+        if ((ob = pamiec_operand(b)) == NULL) fprintf(stderr, "Blad wczytywania %s\n", p->we[1]);
+        else kod = oblicz_dzialanie(p->arg[1], oa, ob, w, tytul);
+        pamiec_oddaj(b);
+    }
+    pamiec_oddaj(a);
+    *ptyp = w->zespolona ? TYP_COMPLEX : TYP_FLOAT;
+    return kod;
+}
+
+// Watek jednego polecenia: liczy i zapisuje plik wynikowy od razu, a na wyjscie sesji pisze
+// dopiero, gdy wypisaly sie wszystkie wczesniejsze polecenia.
+static void *wykonaj_polecenie(void *arg) {
+    Polecenie *p = arg;
+    Sesja *s = p->s;
+    Operand w;
+    const char *tytul = NULL;
+    int typ = TYP_FLOAT, kod = 0, statystyki = p->argc == 1 && strcmp(p->arg[0], "stats") == 0;
+    memset(&w, 0, sizeof(w));
+    if (!statystyki) kod = oblicz_polecenie(p, &w, &tytul, &typ);
+    if (!kod && p->wy) {
+        pamiec_uniewaznij(p->wy);
+        if (zapisz_wynik(p->wy, &w, typ)) { fprintf(stderr, "Blad zapisu %s\n", p->wy); kod = 1; }
+    }
+    zwolnij_bufory_watku();
+    pthread_mutex_lock(&s->mutex);
+    while (s->wypisane != p->nr) pthread_cond_wait(&s->zmiana, &s->mutex);
+    pthread_mutex_unlock(&s->mutex);
+    if (statystyki) raport_pamieci(s->fd_wy);
+    else if (!kod && !opcje.cichy) pokaz_wynik(s->fd_wy, tytul, &w, typ);
+    if (s->protokol) dprintf(s->fd_wy, kod ? "BLAD\n" : "OK\n");
+    zwolnij_operand(&w);
+    pthread_mutex_lock(&s->mutex);
+    for (int i = 0; i < s->aktywne; ++i)
+        if (s->w_toku[i] == p) { s->w_toku[i] = s->w_toku[--s->aktywne]; break; }
+    s->bledy += kod;
+    s->wypisane++;
+    pthread_cond_broadcast(&s->zmiana);
+    pthread_mutex_unlock(&s->mutex);
+    free(p->tekst);
+    free(p);
+    pthread_mutex_lock(&polecenia.mutex);
+    polecenia.biegnace--;
+    pthread_cond_broadcast(&polecenia.zmiana);
+    pthread_mutex_unlock(&polecenia.mutex);
+    return NULL;
+}
+
+// Czyta polecenia ze zrodla az do konca danych albo "quit"; zwraca liczbe nieudanych polecen.
+static int obsluz_sesje(Zrodlo *z, int fd_wy, int protokol) {
+    Sesja s;
+    memset(&s, 0, sizeof(s));
+    s.fd_wy = fd_wy;
+    s.protokol = protokol;
+    s.limit = opcje.zadania > 0 ? opcje.zadania : opcje.watki;
+    if ((s.w_toku = calloc((size_t)s.limit, sizeof(Polecenie *))) == NULL) { fprintf(stderr, "Brak pamieci!\n"); return 1; }
+    pthread_mutex_init(&s.mutex, NULL);
+    pthread_cond_init(&s.zmiana, NULL);
+    const char *p, *e;
+    while (!koniec_serwera && nastepna_linia(z, &p, &e)) {
+        Polecenie *pol = calloc(1, sizeof(Polecenie));
+        int n = pol ? podziel_polecenie(p, e, pol) : -1;
+        int koniec = n > 0 && pol->argc == 1 && strcmp(pol->arg[0], "quit") == 0;
+        if (n <= 0 || koniec) {
+            if (pol) free(pol->tekst);
+            free(pol);
+            if (n < 0) { fprintf(stderr, "Brak pamieci!\n"); s.bledy++; }
+            if (koniec && protokol) koniec_serwera = 1;
+            if (n < 0 || koniec) break;
+            continue;
+        }
+        pol->s = &s;
+        pthread_mutex_lock(&s.mutex);
+        while (s.aktywne >= s.limit || koliduje(&s, pol)) pthread_cond_wait(&s.zmiana, &s.mutex);
+        s.w_toku[s.aktywne++] = pol;
+        pol->nr = s.wydane++;
+        pthread_mutex_unlock(&s.mutex);
+        pthread_mutex_lock(&polecenia.mutex);
+        polecenia.biegnace++;
+        pthread_mutex_unlock(&polecenia.mutex);
+        pthread_t t;
+        if (pthread_create(&t, NULL, wykonaj_polecenie, pol) == 0) pthread_detach(t);
+        else wykonaj_polecenie(pol);
+    }
+    pthread_mutex_lock(&s.mutex);
+    while (s.aktywne > 0) pthread_cond_wait(&s.zmiana, &s.mutex);
+    pthread_mutex_unlock(&s.mutex);
+    pthread_cond_destroy(&s.zmiana);
+    pthread_mutex_destroy(&s.mutex);
+    free(s.w_toku);
+    return s.bledy;
+}
+
+static int tryb_wsadowy(const char *nazwa) {
+    Zrodlo z;
+    if (otworz_zrodlo(&z, nazwa) != 0) { fprintf(stderr, "Nie mozna otworzyc pliku %s\n", nazwa); return 1; }
+    int bledy = obsluz_sesje(&z, STDOUT_FILENO, 0);
+    zamknij_zrodlo(&z);
+    raport_pamieci(STDERR_FILENO);
+    return bledy ? 1 : 0;
+}
+
+static void zatrzymaj_serwer(int sig) { (void)sig; koniec_serwera = 1; }
+static void *obsluz_polaczenie(void *arg) {
+    Zrodlo z;
+    memset(&z, 0, sizeof(z));
+    z.fd = (int)(long)arg;
+    obsluz_sesje(&z, z.fd, 1);
+    zamknij_zrodlo(&z);
+    return NULL;
+}
+// Kazde polaczenie to osobna sesja; pamiec podreczna jest wspolna. Gniazdo nasluchujace jest
+// sprawdzane co 200 ms, zeby sygnal odebrany przez dowolny watek zatrzymal petle.
+static int serwer(const char *sciezka) {
+    struct sockaddr_un adres;
+    memset(&adres, 0, sizeof(adres));
+    adres.sun_family = AF_UNIX;
+    if (strlen(sciezka) >= sizeof(adres.sun_path)) { fprintf(stderr, "Za dluga sciezka gniazda: %s\n", sciezka); return 1; }
+    strcpy(adres.sun_path, sciezka);
+    struct stat st;
+    if (lstat(sciezka, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) { fprintf(stderr, "%s istnieje i nie jest gniazdem!\n", sciezka); return 1; }
+        unlink(sciezka);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&adres, sizeof(adres)) != 0 || listen(fd, 64) != 0) {
+        fprintf(stderr, "Nie mozna utworzyc gniazda %s: %s\n", sciezka, strerror(errno));
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = zatrzymaj_serwer;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "Serwer nasluchuje na %s\n", sciezka);
+    while (!koniec_serwera) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 200) <= 0) continue;
+        int k = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+        if (k < 0) continue;
+        pthread_t t;
+        if (pthread_create(&t, NULL, obsluz_polaczenie, (void *)(long)k) == 0) pthread_detach(t);
+        else close(k);
+    }
+    close(fd);
+    unlink(sciezka);
+    pthread_mutex_lock(&polecenia.mutex);
+    while (polecenia.biegnace > 0) pthread_cond_wait(&polecenia.zmiana, &polecenia.mutex);
+    pthread_mutex_unlock(&polecenia.mutex);
+    raport_pamieci(STDERR_FILENO);
+    return 0;
 }
 
 // --- main ---
 int main(int argc, char **argv) {
+    wybierz_jadra();
+    if (wczytaj_opcje(&argc, argv) != 0) return 1;
+    if (opcje.watki == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        opcje.watki = n > 0 ? (int)n : 1;
+    }
+    uruchom_pule(opcje.watki);
+    if (argc >= 2 && strcmp(argv[1], "convert") == 0) {
+        if (argc != 4) { fprintf(stderr, "Uzycie: %s convert wejscie wyjscie(.txt|.bin)\n", argv[0]); return 1; }
+        return konwertuj(argv[2], argv[3]);
+    }
+    if (precyzja == PRECYZJA_F64 && argc >= 2 && (strcmp(argv[1], "-e") == 0 || strcmp(argv[1], "batch") == 0 || strcmp(argv[1], "serve") == 0)) {
+        fprintf(stderr, "--precision f64 dziala tylko dla pojedynczego dzialania (mac1 op mac2, mac ^)\n");
+        return 1;
+    }
+    if (argc >= 2 && strcmp(argv[1], "-e") == 0) {
+        if (argc < 3) { fprintf(stderr, "Uzycie: %s -e \"(A*B)+C^\" A=mac1.txt B=mac2.txt C=mac3.txt [-o wynik.txt]\n", argv[0]); return 1; }
+        return oblicz_wyrazenie(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+        int n = 0, format = 0;
+        for (int i = 2; i < argc; ++i) {
+            if (strcmp(argv[i], "csv") == 0) format = 1;
+            else if (strcmp(argv[i], "json") == 0) format = 2;
+            else if ((n = atoi(argv[i])) < 16) { fprintf(stderr, "Nieprawidlowy rozmiar benchmarku!\n"); return 1; }
+        }
+        if (n == 0) n = format ? 512 : 1024;
+        return format ? bench_przeglad(n, format == 2) : bench_mnozenie(n);
+    }
+    if (argc >= 2 && strcmp(argv[1], "batch") == 0) {
+        if (argc > 3) { fprintf(stderr, "Uzycie: %s batch [polecenia.txt|-]\n", argv[0]); return 1; }
+        return tryb_wsadowy(argc == 3 ? argv[2] : "-");
+    }
+    if (argc >= 2 && strcmp(argv[1], "serve") == 0) {
+        if (argc != 3) { fprintf(stderr, "Uzycie: %s serve /sciezka/gniazda\n", argv[0]); return 1; }
+        return serwer(argv[2]);
+    }
     if (argc < 3) {
         printf("Uzycie:\n");
         printf("  %s mac1.txt + mac2.txt [wynik.txt]\n", argv[0]);
@@ -324,6 +4841,24 @@ int main(int argc, char **argv) {
         printf("  %s mac1.txt * mac2.txt [wynik.txt]\n", argv[0]);
         printf("  %s mac1.txt ^ [wynik.txt]\n", argv[0]);
         printf("  %s mac2.txt ^ [wynik.txt]\n", argv[0]);
+        printf("  %s -e \"(A*B)+C^\" A=mac1.txt B=mac2.txt C=mac3.txt [-o wynik.txt]\n", argv[0]);
+        printf("  %s convert wejscie wyjscie(.txt|.bin)\n", argv[0]);
+        printf("  %s bench [n] [csv|json]\n", argv[0]);
+        printf("  %s batch [polecenia.txt|-]   polecenia \"a op b [wynik]\" po jednym w wierszu\n", argv[0]);
+        printf("  %s serve /sciezka/gniazda    to samo przez gniazdo uniksowe\n", argv[0]);
+        printf("Opcje:\n");
+        printf("  --threads N   liczba watkow (domyslnie liczba rdzeni)\n");
+        printf("  --quiet, --no-print   nie wypisuj wyniku (tylko zapis do pliku)\n");
+        printf("  --strassen N     mnozenie Strassena-Winograda, gdy wszystkie wymiary > N (np. 1024; 0 - wylaczone)\n");
+        printf("  --complex-layout planar|interleaved   mnozenie zespolone na plaszczyznach re/im (domyslnie) albo na parach\n");
+        printf("  --3m             iloczyn zespolony trzema mnozeniami rzeczywistymi zamiast czterech\n");
+        printf("  --precision f32|mixed|f64   f32 (domyslnie); mixed - dane float, sumy iloczynow w double; f64 - wszystko w double\n");
+        printf("  --mem-limit 8G   budzet pamieci mnozenia; wieksze iloczyny liczone przez pliki tymczasowe ($TMPDIR, domyslnie /var/tmp)\n");
+        printf("  --stream         +, - i ^ strumieniowo paczkami wierszy, w stalej pamieci (przy --mem-limit samo, gdy macierze sie nie mieszcza)\n");
+        printf("  --stats          czasy faz (wykrywanie typu, wczytywanie, obliczenia, wypisywanie, zapis), bajty, GFLOP/s i szczytowe RSS na stderr\n");
+        printf("  --jobs N         rownolegle polecenia w trybie batch/serve (domyslnie liczba watkow)\n");
+        printf("  --cache-size 1G  limit pamieci podrecznej macierzy w trybie batch/serve\n");
+        printf("  --sparse-threshold D  gestosc, ponizej ktorej macierz jest trzymana jako rzadka (domyslnie 0.1, 0 - nigdy)\n");
         return 1;
     }
     if (strstr(argv[1], "CMakeLists.txt")) {
@@ -332,28 +4867,37 @@ int main(int argc, char **argv) {
     }
     if ((argc == 3 || argc == 4) && strcmp(argv[2], "^") == 0) {
         const char *infile = argv[1];
-        int is_complex = 0;
-        FILE *f = fopen(infile, "r");
-        char buf[LINE_BUF_SIZE];
-        if (f) { while (fgets(buf, sizeof(buf), f)) { if (strchr(buf, 'i')) { is_complex = 1; break; } } fclose(f); }
+        if (precyzja == PRECYZJA_F64) return transpozycja_f64(infile, argc == 4 ? argv[3] : NULL);
+        if (opcje.strumien || opcje.limit_pamieci) {
+            int kod = transpozycja_strumieniowa(infile, argc == 4 ? argv[3] : NULL);
+            if (kod >= 0) return kod;
+        }
+        Operand o;
+        if (wczytaj_operand(infile, TYP_AUTO, opcje.prog_rzadkosci, &o) != 0) { fprintf(stderr, "Blad wczytywania %s\n", infile); return 1; }
+        int is_complex = o.zespolona;
+        if (o.rzadka) {
+            Operand t = { 1, o.cols, o.rows, is_complex, NULL, { 0 } };
+            int kod = rzadka_transpozycja(&o.r, &t.r);
+            zwolnij_operand(&o);
+            if (kod) { fprintf(stderr, "Brak pamieci!\n"); return 1; }
+            wypisz_wynik("Transpozycja macierzy", &t, argc == 4 ? argv[3] : NULL, is_complex ? TYP_COMPLEX : TYP_FLOAT);
+            zwolnij_operand(&t);
+            return 0;
+        }
         if (is_complex) {
-            Complex *mat = NULL, *matT = NULL;
-            int rows = 0, cols = 0;
-            if (wczytaj_macierz_complex(infile, &mat, &rows, &cols) != 0) { fprintf(stderr, "Blad wczytywania %s\n", infile); return 1; }
-            matT = malloc((size_t)rows * cols * sizeof(Complex));
-            transpose_complex(mat, matT, rows, cols);
-            printf("Transpozycja macierzy:\n"); wypisz_macierz_complex(matT, cols, rows);
-            if (argc == 4) save_matrix_complex(argv[3], matT, cols, rows);
-            free(mat); free(matT);
+            Complex *mat = o.dane;
+            int rows = o.rows, cols = o.cols;
+            if (transpose_complex_inplace(mat, rows, cols) != 0) { fprintf(stderr, "Brak pamieci!\n"); zwolnij_macierz(mat); return 1; }
+            if (!opcje.cichy) { printf("Transpozycja macierzy:\n"); wypisz_macierz_complex(mat, cols, rows); }
+            if (argc == 4) save_matrix_complex(argv[3], mat, cols, rows);
+            zwolnij_macierz(mat);
         } else {
-            float *mat = NULL, *matT = NULL;
-            int rows = 0, cols = 0;
-            if (wczytaj_macierz(infile, &mat, &rows, &cols) != 0) { fprintf(stderr, "Blad wczytywania %s\n", infile); return 1; }
-            matT = malloc((size_t)rows * cols * sizeof(float));
-            transpose_float(mat, matT, rows, cols);
-            printf("Transpozycja macierzy:\n"); wypisz_macierz(matT, cols, rows);
-            if (argc == 4) save_matrix_float(argv[3], matT, cols, rows);
-            free(mat); free(matT);
+            float *mat = o.dane;
+            int rows = o.rows, cols = o.cols;
+            if (transpose_float_inplace(mat, rows, cols) != 0) { fprintf(stderr, "Brak pamieci!\n"); zwolnij_macierz(mat); return 1; }
+            if (!opcje.cichy) { printf("Transpozycja macierzy:\n"); wypisz_macierz(mat, cols, rows); }
+            if (argc == 4) save_matrix_float(argv[3], mat, cols, rows);
+            zwolnij_macierz(mat);
         }
         return 0;
     }
@@ -366,32 +4910,54 @@ int main(int argc, char **argv) {
         fprintf(stderr, "Nieprawidlowy plik macierzy!\n");
         return 1;
     }
-    int is_complex = 0;
-    FILE *f = fopen(file1, "r");
-    char buf[LINE_BUF_SIZE];
-    if (f) { while (fgets(buf, sizeof(buf), f)) { if (strchr(buf, 'i')) { is_complex = 1; break; } } fclose(f); }
+    if (precyzja == PRECYZJA_F64) return dzialanie_f64(file1, op, file2, outfile);
+    if ((opcje.strumien || opcje.limit_pamieci) && (strcmp(op, "+") == 0 || strcmp(op, "-") == 0)) {
+        int kod = suma_strumieniowa(file1, op, file2, outfile);
+        if (kod >= 0) return kod;
+    }
+    if (opcje.limit_pamieci && strcmp(op, "*") == 0) {
+        // Kafelki sa czytane strumieniowo, wiec typ musi byc znany przed pierwszym odczytem.
+        int typ = plik_zespolony(file1) || plik_zespolony(file2) ? TYP_COMPLEX : TYP_FLOAT;
+        int kod = mnozenie_poza_pamiecia(file1, file2, typ, outfile);
+        if (kod >= 0) return kod;
+    }
+    // Typ kazdego pliku wykrywany przy jedynym przebiegu wczytywania.
+    Operand op1, op2;
+    if (wczytaj_operand(file1, TYP_AUTO, opcje.prog_rzadkosci, &op1) != 0) { fprintf(stderr, "Blad wczytywania %s\n", file1); return 1; }
+    if (wczytaj_operand(file2, TYP_AUTO, opcje.prog_rzadkosci, &op2) != 0) { fprintf(stderr, "Blad wczytywania %s\n", file2); zwolnij_operand(&op1); return 1; }
+    if (op1.rzadka || op2.rzadka || op1.zespolona != op2.zespolona) {
+        int kod = dzialanie_operandow(op, &op1, &op2, outfile);
+        zwolnij_operand(&op1); zwolnij_operand(&op2);
+        return kod;
+    }
+    int is_complex = op1.zespolona;
     if (is_complex) {
-        Complex *mat1 = NULL, *mat2 = NULL, *mat_wynik = NULL;
-        int rows1 = 0, cols1 = 0, rows2 = 0, cols2 = 0;
-        if (wczytaj_macierz_complex(file1, &mat1, &rows1, &cols1) != 0) { fprintf(stderr, "Blad wczytywania %s\n", file1); return 1; }
-        if (wczytaj_macierz_complex(file2, &mat2, &rows2, &cols2) != 0) { fprintf(stderr, "Blad wczytywania %s\n", file2); free(mat1); return 1; }
+        Complex *mat1 = op1.dane, *mat2 = op2.dane, *mat_wynik = NULL;
+        int rows1 = op1.rows, cols1 = op1.cols, rows2 = op2.rows, cols2 = op2.cols;
         if (strcmp(op, "+") == 0) {
-            if (rows1 != rows2 || cols1 != cols2) { fprintf(stderr, "Nie mozna dodac macierzy o roznych rozmiarach!\n"); free(mat1); free(mat2); return 1; }
+            if (rows1 != rows2 || cols1 != cols2) { fprintf(stderr, "Nie mozna dodac macierzy o roznych rozmiarach!\n"); zwolnij_macierz(mat1); zwolnij_macierz(mat2); return 1; }
             mat_wynik = malloc((size_t)rows1 * cols1 * sizeof(Complex));
+            if (!mat_wynik) { fprintf(stderr, "Brak pamieci na wynik!\n"); zwolnij_macierz(mat1); zwolnij_macierz(mat2); return 1; }
             dodaj_macierze_complex(mat1, mat2, mat_wynik, rows1, cols1);
-            printf("Suma macierzy:\n"); wypisz_macierz_complex(mat_wynik, rows1, cols1);
+            if (!opcje.cichy) { printf("Suma macierzy:\n"); wypisz_macierz_complex(mat_wynik, rows1, cols1); }
             if (outfile) save_matrix_complex(outfile, mat_wynik, rows1, cols1);
         } else if (strcmp(op, "-") == 0) {
-            if (rows1 != rows2 || cols1 != cols2) { fprintf(stderr, "Nie mozna odjac macierzy o roznych rozmiarach!\n"); free(mat1); free(mat2); return 1; }
+            if (rows1 != rows2 || cols1 != cols2) { fprintf(stderr, "Nie mozna odjac macierzy o roznych rozmiarach!\n"); zwolnij_macierz(mat1); zwolnij_macierz(mat2); return 1; }
             mat_wynik = malloc((size_t)rows1 * cols1 * sizeof(Complex));
+            if (!mat_wynik) { fprintf(stderr, "Brak pamieci na wynik!\n"); zwolnij_macierz(mat1); zwolnij_macierz(mat2); return 1; }
             odejmij_macierze_complex(mat1, mat2, mat_wynik, rows1, cols1);
-            printf("Roznica macierzy:\n"); wypisz_macierz_complex(mat_wynik, rows1, cols1);
+            if (!opcje.cichy) { printf("Roznica macierzy:\n"); wypisz_macierz_complex(mat_wynik, rows1, cols1); }
             if (outfile) save_matrix_complex(outfile, mat_wynik, rows1, cols1);
         } else if (strcmp(op, "*") == 0) {
-            if (cols1 != rows2) { fprintf(stderr, "Nie mozna mnozyc: liczba kolumn macierzy 1 musi byc rowna liczbie wierszy macierzy 2!\n"); free(mat1); free(mat2); return 1; }
+            if (cols1 != rows2) { fprintf(stderr, "Nie mozna mnozyc: liczba kolumn macierzy 1 musi byc rowna liczbie wierszy macierzy 2!\n"); zwolnij_macierz(mat1); zwolnij_macierz(mat2); return 1; }
+            if ((uklad_planarny && precyzja != PRECYZJA_MIESZANA) || mnozenie_3m) {
+                int kod = iloczyn_planarny(mat1, rows1, cols1, mat2, cols2, outfile, opcje.cichy);
+                if (kod >= 0) return kod;
+            }
             mat_wynik = malloc((size_t)rows1 * cols2 * sizeof(Complex));
-            mnoz_macierze_complex(mat1, rows1, cols1, mat2, rows2, cols2, mat_wynik);
-            printf("Iloczyn macierzy:\n"); wypisz_macierz_complex(mat_wynik, rows1, cols2);
+            if (!mat_wynik) { fprintf(stderr, "Brak pamieci na wynik! Uzyj --mem-limit, aby mnozyc przez pliki tymczasowe.\n"); zwolnij_macierz(mat1); zwolnij_macierz(mat2); return 1; }
+            if (mnoz_macierze_complex(mat1, rows1, cols1, mat2, rows2, cols2, mat_wynik)) { fprintf(stderr, "Brak pamieci!\n"); zwolnij_macierz(mat1); zwolnij_macierz(mat2); free(mat_wynik); return 1; }
+            if (!opcje.cichy) { printf("Iloczyn macierzy:\n"); wypisz_macierz_complex(mat_wynik, rows1, cols2); }
             if (outfile) save_matrix_complex(outfile, mat_wynik, rows1, cols2);
         } else {
             /* Poprzez rozszerzanie globów (np. gdy wpiszesz * bez ucieczki), powłoka może zastąpić '*' listą plików.
@@ -405,31 +4971,32 @@ int main(int argc, char **argv) {
             } else {
                 fprintf(stderr, "Nieznana operacja: %s\n", op);
             }
-            free(mat1); free(mat2); return 1;
+            zwolnij_macierz(mat1); zwolnij_macierz(mat2); return 1;
         }
-        free(mat1); free(mat2); free(mat_wynik);
+        zwolnij_macierz(mat1); zwolnij_macierz(mat2); free(mat_wynik);
     } else {
-        float *mat1 = NULL, *mat2 = NULL, *mat_wynik = NULL;
-        int rows1 = 0, cols1 = 0, rows2 = 0, cols2 = 0;
-        if (wczytaj_macierz(file1, &mat1, &rows1, &cols1) != 0) { fprintf(stderr, "Blad wczytywania %s\n", file1); return 1; }
-        if (wczytaj_macierz(file2, &mat2, &rows2, &cols2) != 0) { fprintf(stderr, "Blad wczytywania %s\n", file2); free(mat1); return 1; }
+        float *mat1 = op1.dane, *mat2 = op2.dane, *mat_wynik = NULL;
+        int rows1 = op1.rows, cols1 = op1.cols, rows2 = op2.rows, cols2 = op2.cols;
         if (strcmp(op, "+") == 0) {
-            if (rows1 != rows2 || cols1 != cols2) { fprintf(stderr, "Nie mozna dodac macierzy o roznych rozmiarach!\n"); free(mat1); free(mat2); return 1; }
+            if (rows1 != rows2 || cols1 != cols2) { fprintf(stderr, "Nie mozna dodac macierzy o roznych rozmiarach!\n"); zwolnij_macierz(mat1); zwolnij_macierz(mat2); return 1; }
             mat_wynik = malloc((size_t)rows1 * cols1 * sizeof(float));
+            if (!mat_wynik) { fprintf(stderr, "Brak pamieci na wynik!\n"); zwolnij_macierz(mat1); zwolnij_macierz(mat2); return 1; }
             dodaj_macierze(mat1, mat2, mat_wynik, rows1, cols1);
-            printf("Suma macierzy:\n"); wypisz_macierz(mat_wynik, rows1, cols1);
+            if (!opcje.cichy) { printf("Suma macierzy:\n"); wypisz_macierz(mat_wynik, rows1, cols1); }
             if (outfile) save_matrix_float(outfile, mat_wynik, rows1, cols1);
         } else if (strcmp(op, "-") == 0) {
-            if (rows1 != rows2 || cols1 != cols2) { fprintf(stderr, "Nie mozna odjac macierzy o roznych rozmiarach!\n"); free(mat1); free(mat2); return 1; }
+            if (rows1 != rows2 || cols1 != cols2) { fprintf(stderr, "Nie mozna odjac macierzy o roznych rozmiarach!\n"); zwolnij_macierz(mat1); zwolnij_macierz(mat2); return 1; }
             mat_wynik = malloc((size_t)rows1 * cols1 * sizeof(float));
+            if (!mat_wynik) { fprintf(stderr, "Brak pamieci na wynik!\n"); zwolnij_macierz(mat1); zwolnij_macierz(mat2); return 1; }
             odejmij_macierze(mat1, mat2, mat_wynik, rows1, cols1);
-            printf("Roznica macierzy:\n"); wypisz_macierz(mat_wynik, rows1, cols1);
+            if (!opcje.cichy) { printf("Roznica macierzy:\n"); wypisz_macierz(mat_wynik, rows1, cols1); }
             if (outfile) save_matrix_float(outfile, mat_wynik, rows1, cols1);
         } else if (strcmp(op, "*") == 0) {
-            if (cols1 != rows2) { fprintf(stderr, "Nie mozna mnozyc: liczba kolumn macierzy 1 musi byc rowna liczbie wierszy macierzy 2!\n"); free(mat1); free(mat2); return 1; }
+            if (cols1 != rows2) { fprintf(stderr, "Nie mozna mnozyc: liczba kolumn macierzy 1 musi byc rowna liczbie wierszy macierzy 2!\n"); zwolnij_macierz(mat1); zwolnij_macierz(mat2); return 1; }
             mat_wynik = malloc((size_t)rows1 * cols2 * sizeof(float));
-            mnoz_macierze(mat1, rows1, cols1, mat2, rows2, cols2, mat_wynik);
-            printf("Iloczyn macierzy:\n"); wypisz_macierz(mat_wynik, rows1, cols2);
+            if (!mat_wynik) { fprintf(stderr, "Brak pamieci na wynik! Uzyj --mem-limit, aby mnozyc przez pliki tymczasowe.\n"); zwolnij_macierz(mat1); zwolnij_macierz(mat2); return 1; }
+            if (mnoz_macierze(mat1, rows1, cols1, mat2, rows2, cols2, mat_wynik)) { fprintf(stderr, "Brak pamieci!\n"); zwolnij_macierz(mat1); zwolnij_macierz(mat2); free(mat_wynik); return 1; }
+            if (!opcje.cichy) { printf("Iloczyn macierzy:\n"); wypisz_macierz(mat_wynik, rows1, cols2); }
             if (outfile) save_matrix_float(outfile, mat_wynik, rows1, cols2);
         } else {
             /* Poprzez rozszerzanie globów (np. gdy wpiszesz * bez ucieczki), powłoka może zastąpić '*' listą plików.
@@ -443,9 +5010,9 @@ int main(int argc, char **argv) {
             } else {
                 fprintf(stderr, "Nieznana operacja: %s\n", op);
             }
-            free(mat1); free(mat2); return 1;
+            zwolnij_macierz(mat1); zwolnij_macierz(mat2); return 1;
         }
-        free(mat1); free(mat2); free(mat_wynik);
+        zwolnij_macierz(mat1); zwolnij_macierz(mat2); free(mat_wynik);
     }
     return 0;
 }
\ No newline at end of file